@@ -0,0 +1,303 @@
+// augment.c - random shift / rotation / elastic warps of image columns
+#include <augment.h>
+#include <rng.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define PARAMS_PER_SAMPLE 64 // rng words reserved per sample: dx, dy, angle, 2 * GRID^2 field
+#define MAX_THREADS 64
+#define TILE 16
+
+typedef struct {
+	const Augment *a;
+	uint64_t stream;
+	const Matrix *src;
+	const MatrixU8 *src_u8;
+	Matrix *dst;
+	MatrixU8 *dst_u8;
+	int col0;
+	int begin, end;     // dst columns of this worker
+} AugmentTask;
+
+// Per-worker row buffers for warp_sample.
+typedef struct {
+	float *hat_x;   // (GRID x width) weight of grid column g at pixel x
+	float *hat_y;   // (GRID x height)
+	int *tap;       // (width) index of the top-left source tap in `padded`
+	float *tx;      // (width) bilinear fractions
+	float *ty;
+	float *p00;     // (width) gathered source taps
+	float *p10;
+	float *p01;
+	float *p11;
+} WarpRows;
+
+// hat[g * n + i]: linear interpolation weight of grid node g at pixel i,
+// so a row of the elastic field is a weighted sum of GRID node values
+static void grid_hat_weights(float *hat, int n)
+{
+	float scale = (float)(AUGMENT_GRID - 1) / (float)(n > 1 ? n - 1 : 1);
+
+	for (int g = 0; g < AUGMENT_GRID; ++g) {
+		for (int i = 0; i < n; ++i) {
+			float d = fabsf((float)i * scale - (float)g);
+			hat[g * n + i] = d < 1.0f ? 1.0f - d : 0.0f;
+		}
+	}
+}
+
+static void warp_rows_init(WarpRows *r, int W, int H)
+{
+	r->hat_x = (float *)malloc((size_t)AUGMENT_GRID * W * sizeof(float));
+	r->hat_y = (float *)malloc((size_t)AUGMENT_GRID * H * sizeof(float));
+	r->tap = (int *)malloc((size_t)W * sizeof(int));
+
+	float **rows[] = { &r->tx, &r->ty, &r->p00, &r->p10, &r->p01, &r->p11 };
+	bool ok = r->hat_x && r->hat_y && r->tap;
+	for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); ++i) {
+		*rows[i] = (float *)malloc((size_t)W * sizeof(float));
+		ok = ok && *rows[i];
+	}
+	if (!ok) {
+		fprintf(stderr, "Failed to allocate augmentation buffers\n");
+		exit(1);
+	}
+
+	grid_hat_weights(r->hat_x, W);
+	grid_hat_weights(r->hat_y, H);
+}
+
+static void warp_rows_free(WarpRows *r)
+{
+	free(r->hat_x); free(r->hat_y); free(r->tap);
+	free(r->tx); free(r->ty);
+	free(r->p00); free(r->p10); free(r->p01); free(r->p11);
+}
+
+// Inverse-maps every output pixel through the sample's warp and samples
+// the source bilinearly. Each row runs in three passes: source coordinates
+// and tap indices (vectorized across x), the four-tap gather (AVX2 gathers
+// when available, scalar loads otherwise), and the bilinear blend
+// (vectorized). `padded` has a zero border of one pixel on
+// the top/left and two on the bottom/right, so every tap is in bounds and
+// no pass needs a branch.
+static void warp_sample(const Augment *a, const float *params, const float *padded, WarpRows *r, float *out)
+{
+	int W = a->width;
+	int H = a->height;
+	int PW = W + 3;
+
+	float dx = params[0] * a->max_shift;
+	float dy = params[1] * a->max_shift;
+	float theta = params[2] * a->max_rotate * (3.14159265f / 180.0f);
+	const float *field = params + 3; // (GRID x GRID) x/y displacements in [-1, 1)
+
+	float c = cosf(theta);
+	float s = sinf(theta);
+	float cx = 0.5f * (float)(W - 1);
+	float cy = 0.5f * (float)(H - 1);
+
+	for (int y = 0; y < H; ++y) {
+		// this row of the elastic field at the GRID nodes along x
+		float node_x[AUGMENT_GRID];
+		float node_y[AUGMENT_GRID];
+		for (int g = 0; g < AUGMENT_GRID; ++g) {
+			node_x[g] = 0.0f;
+			node_y[g] = 0.0f;
+			for (int k = 0; k < AUGMENT_GRID; ++k) {
+				float w = r->hat_y[k * H + y] * a->elastic;
+				node_x[g] += w * field[2 * (k * AUGMENT_GRID + g)];
+				node_y[g] += w * field[2 * (k * AUGMENT_GRID + g) + 1];
+			}
+		}
+
+		// rotate about the centre, then shift and displace
+		float ry = (float)y - cy;
+		float bx = s * ry + cx - dx;
+		float by = c * ry + cy - dy;
+
+		int *restrict tap = r->tap;
+		float *restrict tx = r->tx;
+		float *restrict ty = r->ty;
+
+		for (int x = 0; x < W; ++x) {
+			float ex = 0.0f;
+			float ey = 0.0f;
+			for (int g = 0; g < AUGMENT_GRID; ++g) {
+				ex += node_x[g] * r->hat_x[g * W + x];
+				ey += node_y[g] * r->hat_x[g * W + x];
+			}
+
+			float rx = (float)x - cx;
+			float sx = c * rx + bx + ex;
+			float sy = -s * rx + by + ey;
+
+			// clamp into the padded border: everything outside reads zeros;
+			// sx + 1 >= 0 from here on, so truncation is floor
+			sx = sx < -1.0f ? -1.0f : sx;
+			sx = sx > (float)W ? (float)W : sx;
+			sy = sy < -1.0f ? -1.0f : sy;
+			sy = sy > (float)H ? (float)H : sy;
+
+			int ix = (int)(sx + 1.0f);
+			int iy = (int)(sy + 1.0f);
+			tx[x] = sx + 1.0f - (float)ix;
+			ty[x] = sy + 1.0f - (float)iy;
+			tap[x] = iy * PW + ix;
+		}
+
+		int x = 0;
+#if defined(__AVX2__)
+		for (; x + 8 <= W; x += 8) {
+			__m256i t = _mm256_loadu_si256((const __m256i *)(tap + x));
+			_mm256_storeu_ps(r->p00 + x, _mm256_i32gather_ps(padded, t, 4));
+			_mm256_storeu_ps(r->p10 + x, _mm256_i32gather_ps(padded + 1, t, 4));
+			_mm256_storeu_ps(r->p01 + x, _mm256_i32gather_ps(padded + PW, t, 4));
+			_mm256_storeu_ps(r->p11 + x, _mm256_i32gather_ps(padded + PW + 1, t, 4));
+		}
+#endif
+		for (; x < W; ++x) {
+			const float *p = padded + tap[x];
+			r->p00[x] = p[0];
+			r->p10[x] = p[1];
+			r->p01[x] = p[PW];
+			r->p11[x] = p[PW + 1];
+		}
+
+		const float *restrict p00 = r->p00;
+		const float *restrict p10 = r->p10;
+		const float *restrict p01 = r->p01;
+		const float *restrict p11 = r->p11;
+		float *restrict row = out + (size_t)y * W;
+
+		for (x = 0; x < W; ++x) {
+			row[x] = (1.0f - ty[x]) * ((1.0f - tx[x]) * p00[x] + tx[x] * p10[x])
+			       + ty[x] * ((1.0f - tx[x]) * p01[x] + tx[x] * p11[x]);
+		}
+	}
+}
+
+static void *augment_worker(void *arg)
+{
+	AugmentTask *t = (AugmentTask *)arg;
+	const Augment *a = t->a;
+	int W = a->width;
+	int H = a->height;
+	size_t pixels = (size_t)W * H;
+	size_t padded_size = (size_t)(W + 3) * (H + 3);
+	size_t src_cols = (size_t)(t->src ? t->src->cols : t->src_u8->cols);
+	size_t dst_cols = (size_t)(t->dst ? t->dst->cols : t->dst_u8->cols);
+
+	// columns are handled TILE at a time so the strided gather/scatter
+	// touches contiguous runs of each pixel row
+	float *padded = (float *)calloc(TILE * padded_size, sizeof(float));
+	float *out = (float *)malloc(TILE * pixels * sizeof(float));
+	float params[PARAMS_PER_SAMPLE];
+	WarpRows rows;
+
+	if (!padded || !out) {
+		fprintf(stderr, "Failed to allocate augmentation buffers\n");
+		exit(1);
+	}
+	warp_rows_init(&rows, W, H);
+
+	Rng rng;
+	rng_seed(&rng, a->seed, t->stream);
+
+	for (int i0 = t->begin; i0 < t->end; i0 += TILE) {
+		int n = (t->end - i0 < TILE) ? t->end - i0 : TILE;
+		size_t s0 = (size_t)(t->col0 + i0);
+
+		for (size_t p = 0; p < pixels; ++p) {
+			size_t at = (p / W + 1) * (W + 3) + p % W + 1;
+			for (int j = 0; j < n; ++j) {
+				padded[j * padded_size + at] =
+					t->src ? t->src->data[p * src_cols + s0 + j]
+					       : (float)t->src_u8->data[p * src_cols + s0 + j];
+			}
+		}
+
+		for (int j = 0; j < n; ++j) {
+			rng_fill_uniform_at(&rng, (s0 + j) * PARAMS_PER_SAMPLE, params,
+			                    3 + 2 * AUGMENT_GRID * AUGMENT_GRID, -1.0f, 1.0f);
+			warp_sample(a, params, padded + j * padded_size, &rows, out + j * pixels);
+		}
+
+		for (size_t p = 0; p < pixels; ++p) {
+			if (t->dst) {
+				float *row = t->dst->data + p * dst_cols + i0;
+				for (int j = 0; j < n; ++j) {
+					row[j] = out[j * pixels + p];
+				}
+			} else {
+				unsigned char *row = t->dst_u8->data + p * dst_cols + i0;
+				for (int j = 0; j < n; ++j) {
+					float v = out[j * pixels + p] + 0.5f;
+					row[j] = (unsigned char)(v > 255.0f ? 255.0f : v);
+				}
+			}
+		}
+	}
+
+	warp_rows_free(&rows);
+	free(padded);
+	free(out);
+	return NULL;
+}
+
+static void augment_run(AugmentTask *proto, int cols)
+{
+	int threads = proto->a->threads;
+	if (threads < 1) threads = 1;
+	if (threads > MAX_THREADS) threads = MAX_THREADS;
+	if (threads > cols) threads = cols > 0 ? cols : 1;
+
+	AugmentTask tasks[MAX_THREADS];
+	pthread_t tids[MAX_THREADS];
+
+	for (int t = 0; t < threads; ++t) {
+		tasks[t] = *proto;
+		tasks[t].begin = (int)((long)cols * t / threads);
+		tasks[t].end = (int)((long)cols * (t + 1) / threads);
+	}
+
+	// the calling thread takes the first share
+	int spawned = 1;
+	for (; spawned < threads; ++spawned) {
+		if (pthread_create(&tids[spawned], NULL, augment_worker, &tasks[spawned]) != 0) break;
+	}
+	augment_worker(&tasks[0]);
+	for (int t = spawned; t < threads; ++t) {
+		augment_worker(&tasks[t]); // thread creation failed: finish inline
+	}
+	for (int t = 1; t < spawned; ++t) {
+		pthread_join(tids[t], NULL);
+	}
+}
+
+void augment_batch(const Augment *a, uint64_t stream, const Matrix *src, int col0, Matrix *dst)
+{
+	if (!a || !src || !dst || !src->data || !dst->data) return;
+	if (src->rows != a->width * a->height || dst->rows != src->rows) return;
+	if (col0 < 0 || col0 + dst->cols > src->cols) return;
+
+	AugmentTask proto = { .a = a, .stream = stream, .src = src, .dst = dst, .col0 = col0 };
+	augment_run(&proto, dst->cols);
+}
+
+void augment_batch_u8(const Augment *a, uint64_t stream, const MatrixU8 *src, int col0, MatrixU8 *dst)
+{
+	if (!a || !src || !dst || !src->data || !dst->data) return;
+	if (src->rows != a->width * a->height || dst->rows != src->rows) return;
+	if (col0 < 0 || col0 + dst->cols > src->cols) return;
+
+	AugmentTask proto = { .a = a, .stream = stream, .src_u8 = src, .dst_u8 = dst, .col0 = col0 };
+	augment_run(&proto, dst->cols);
+}
@@ -0,0 +1,24 @@
+// augment.h - random shift / rotation / elastic warps of image columns
+#pragma once
+
+#include <matrix.h>
+#include <stdint.h>
+
+#define AUGMENT_GRID 4 // control points per axis of the elastic displacement field
+
+typedef struct {
+	int width;          // image geometry, pixels are row-major within a column
+	int height;
+	float max_shift;    // pixels, per axis
+	float max_rotate;   // degrees
+	float elastic;      // peak displacement (pixels) of the smooth noise field
+	int threads;        // workers per batch
+	uint64_t seed;
+} Augment;
+
+// dst[:, i] = warp of src[:, col0 + i] for i < dst->cols. The warp of a
+// sample depends only on (seed, stream, col0 + i), never on threading;
+// stream is typically the epoch, or (epoch, batch) when an epoch has
+// several batches.
+void augment_batch(const Augment *a, uint64_t stream, const Matrix *src, int col0, Matrix *dst);
+void augment_batch_u8(const Augment *a, uint64_t stream, const MatrixU8 *src, int col0, MatrixU8 *dst);
@@ -0,0 +1,397 @@
+// gemm-tune.c - auto-tuner and roofline report for the GEMM kernels
+#include <gemm-tune.h>
+#include <rng.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#define TUNE_MAX_BATCH 1024     // batch dim of the timed proxy problem
+#define TUNE_MIN_SECONDS 0.02   // per timing sample
+#define PEAK_BW_BYTES (64u << 20)
+
+static double tune_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void add_shape(GemmShape *out, int *count, int max, GemmKernel kernel, int m, int n, int p, const char *what)
+{
+	for (int i = 0; i < *count; ++i) {
+		if (out[i].kernel == kernel && out[i].m == m && out[i].n == n && out[i].p == p) return;
+	}
+	if (*count == max) return;
+
+	out[*count] = (GemmShape){ kernel, m, n, p, what };
+	(*count)++;
+}
+
+int gemm_mlp_shapes(GemmShape *out, int max, int input_dim, int hidden1, int hidden2, int num_classes, int batch, bool u8_input)
+{
+	// with uint8 inputs, fc1 runs the _U8 kernels on the raw pixels
+	GemmKernel fc1_ab = u8_input ? GEMM_AB_U8 : GEMM_AB;
+	GemmKernel fc1_a_bt = u8_input ? GEMM_A_BT_U8 : GEMM_A_BT;
+
+	int count = 0;
+
+	// dense_forward: Z (out x B) = W (out x in) · X (in x B)
+	add_shape(out, &count, max, fc1_ab, hidden1, input_dim, batch, "fc1 forward");
+	add_shape(out, &count, max, GEMM_AB, hidden2, hidden1, batch, "fc2 forward");
+	add_shape(out, &count, max, GEMM_AB, num_classes, hidden2, batch, "fc3 forward");
+
+	// dense_backward_acc: dW (out x in) += dZ (out x B) · X (in x B)^T
+	add_shape(out, &count, max, fc1_a_bt, hidden1, batch, input_dim, "fc1 dW");
+	add_shape(out, &count, max, GEMM_A_BT, hidden2, batch, hidden1, "fc2 dW");
+	add_shape(out, &count, max, GEMM_A_BT, num_classes, batch, hidden2, "fc3 dW");
+
+	// dA (in x B) = W (out x in)^T · dZ (out x B); fc1 has no dA
+	add_shape(out, &count, max, GEMM_AT_B, hidden2, hidden1, batch, "fc2 dA");
+	add_shape(out, &count, max, GEMM_AT_B, num_classes, hidden2, batch, "fc3 dA");
+
+	return count;
+}
+
+/* =========================
+   Peak measurements
+   ========================= */
+
+typedef struct {
+	long iters;
+	const float *buf;
+	size_t n;
+	double sink;
+} PeakTask;
+
+// PEAK_CHAINS independent multiply-add chains: enough to cover the
+// mul + add latency on two ports, few enough to stay in the 16 vector
+// registers (a memory-resident accumulator array measures spills instead).
+// The chains are named locals, so they stay in registers at any -O level.
+// The vector width is the one the GEMM kernels are compiled for; without
+// SSE the probe runs on scalars and reports the scalar peak.
+#define PEAK_CHAINS 12
+
+#if defined(__AVX__)
+typedef __m256 PeakVec;
+#define PEAK_LANES 8
+#define peak_set1 _mm256_set1_ps
+#define peak_mul _mm256_mul_ps
+#define peak_add _mm256_add_ps
+#define peak_store _mm256_storeu_ps
+#elif defined(__SSE__)
+typedef __m128 PeakVec;
+#define PEAK_LANES 4
+#define peak_set1 _mm_set1_ps
+#define peak_mul _mm_mul_ps
+#define peak_add _mm_add_ps
+#define peak_store _mm_storeu_ps
+#else
+typedef float PeakVec;
+#define PEAK_LANES 1
+#define peak_set1(x) (x)
+#define peak_mul(x, y) ((x) * (y))
+#define peak_add(x, y) ((x) + (y))
+#define peak_store(dst, x) (*(dst) = (x))
+#endif
+
+#define PEAK_STEP(v) v = peak_add(peak_mul(v, m), a)
+
+static double peak_lane_sum(PeakVec v)
+{
+	float lanes[PEAK_LANES];
+	double sum = 0.0;
+
+	peak_store(lanes, v);
+	for (int j = 0; j < PEAK_LANES; ++j) sum += lanes[j];
+	return sum;
+}
+
+static void *peak_flops_worker(void *arg)
+{
+	PeakTask *t = (PeakTask *)arg;
+	PeakVec m = peak_set1(0.999999f);
+	PeakVec a = peak_set1(1e-7f);
+	PeakVec c0 = peak_set1(0.000f), c1 = peak_set1(0.001f), c2 = peak_set1(0.002f);
+	PeakVec c3 = peak_set1(0.003f), c4 = peak_set1(0.004f), c5 = peak_set1(0.005f);
+	PeakVec c6 = peak_set1(0.006f), c7 = peak_set1(0.007f), c8 = peak_set1(0.008f);
+	PeakVec c9 = peak_set1(0.009f), c10 = peak_set1(0.010f), c11 = peak_set1(0.011f);
+
+	for (long it = 0; it < t->iters; ++it) {
+		PEAK_STEP(c0); PEAK_STEP(c1); PEAK_STEP(c2); PEAK_STEP(c3);
+		PEAK_STEP(c4); PEAK_STEP(c5); PEAK_STEP(c6); PEAK_STEP(c7);
+		PEAK_STEP(c8); PEAK_STEP(c9); PEAK_STEP(c10); PEAK_STEP(c11);
+	}
+
+	PeakVec acc[PEAK_CHAINS] = { c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11 };
+	double sum = 0.0;
+	for (int i = 0; i < PEAK_CHAINS; ++i) sum += peak_lane_sum(acc[i]);
+	t->sink = sum;
+	return NULL;
+}
+
+static void *peak_bw_worker(void *arg)
+{
+	PeakTask *t = (PeakTask *)arg;
+	float sum[16] = {0};
+
+	for (long it = 0; it < t->iters; ++it) {
+		for (size_t i = 0; i + 16 <= t->n; i += 16) {
+			for (int j = 0; j < 16; ++j) sum[j] += t->buf[i + j];
+		}
+	}
+
+	double total = 0.0;
+	for (int j = 0; j < 16; ++j) total += sum[j];
+	t->sink = total;
+	return NULL;
+}
+
+// Runs `worker` on `threads` threads and returns the wall time.
+static double run_peak(void *(*worker)(void *), PeakTask *tasks, int threads)
+{
+	pthread_t tids[64];
+	double t0 = tune_seconds();
+
+	int spawned = 1;
+	for (; spawned < threads; ++spawned) {
+		if (pthread_create(&tids[spawned], NULL, worker, &tasks[spawned]) != 0) break;
+	}
+	worker(&tasks[0]);
+	for (int t = spawned; t < threads; ++t) {
+		worker(&tasks[t]); // thread creation failed: finish inline
+	}
+	for (int t = 1; t < spawned; ++t) pthread_join(tids[t], NULL);
+
+	return tune_seconds() - t0;
+}
+
+static double measure_peak_gflops(int threads)
+{
+	PeakTask tasks[64];
+	long iters = 1 << 16;
+
+	for (;;) {
+		for (int t = 0; t < threads; ++t) tasks[t] = (PeakTask){ .iters = iters };
+		double dt = run_peak(peak_flops_worker, tasks, threads);
+		if (dt >= 0.1) return 2.0 * PEAK_CHAINS * PEAK_LANES * (double)iters * threads / dt * 1e-9;
+		iters *= 2;
+	}
+}
+
+static double measure_peak_gbs(const float *buf, int threads)
+{
+	PeakTask tasks[64];
+	size_t n = PEAK_BW_BYTES / sizeof(float);
+	size_t per = n / (size_t)threads;
+
+	for (int t = 0; t < threads; ++t) {
+		tasks[t] = (PeakTask){ .iters = 4, .buf = buf + per * t, .n = per };
+	}
+	run_peak(peak_bw_worker, tasks, threads); // fault in the pages
+
+	double dt = run_peak(peak_bw_worker, tasks, threads);
+	return 4.0 * (double)(per * threads) * sizeof(float) / dt * 1e-9;
+}
+
+/* =========================
+   Sweep
+   ========================= */
+
+typedef struct {
+	Matrix A, B, C;
+	MatrixU8 Bq;    // B of the _U8 kernels
+} TuneProblem;
+
+static void problem_alloc(TuneProblem *pr, const GemmShape *s, Rng *rng)
+{
+	switch (s->kernel) {
+	case GEMM_AB:
+		mat_alloc(&pr->A, s->m, s->n);
+		mat_alloc(&pr->B, s->n, s->p);
+		mat_alloc(&pr->C, s->m, s->p);
+		break;
+	case GEMM_AT_B:
+		mat_alloc(&pr->A, s->m, s->n);
+		mat_alloc(&pr->B, s->m, s->p);
+		mat_alloc(&pr->C, s->n, s->p);
+		break;
+	case GEMM_AB_U8:
+		mat_alloc(&pr->A, s->m, s->n);
+		mat_u8_alloc(&pr->Bq, s->n, s->p);
+		mat_alloc(&pr->C, s->m, s->p);
+		break;
+	case GEMM_A_BT_U8:
+		mat_alloc(&pr->A, s->m, s->n);
+		mat_u8_alloc(&pr->Bq, s->p, s->n);
+		mat_alloc(&pr->C, s->m, s->p);
+		break;
+	default:
+		mat_alloc(&pr->A, s->m, s->n);
+		mat_alloc(&pr->B, s->p, s->n);
+		mat_alloc(&pr->C, s->m, s->p);
+		break;
+	}
+	mat_rand_uniform(&pr->A, rng, -1.0f, 1.0f);
+	if (pr->Bq.data) {
+		for (size_t i = 0; i < (size_t)pr->Bq.rows * pr->Bq.cols; ++i) {
+			pr->Bq.data[i] = (unsigned char)rng_below(rng, 256);
+		}
+	} else {
+		mat_rand_uniform(&pr->B, rng, -1.0f, 1.0f);
+	}
+}
+
+static void problem_free(TuneProblem *pr)
+{
+	mat_free(&pr->A);
+	mat_free(&pr->B);
+	mat_free(&pr->C);
+	mat_u8_free(&pr->Bq);
+}
+
+static void problem_run(TuneProblem *pr, GemmKernel kernel)
+{
+	switch (kernel) {
+	case GEMM_AB:   mat_mul(&pr->C, &pr->A, &pr->B); break;
+	case GEMM_AT_B: mat_mul_AT_B(&pr->C, &pr->A, &pr->B); break;
+	case GEMM_AB_U8:   mat_mul_u8(&pr->C, &pr->A, &pr->Bq, 1.0f / 255.0f); break;
+	case GEMM_A_BT_U8: mat_mul_A_BT_u8_acc(&pr->C, &pr->A, &pr->Bq, 1.0f / 255.0f); break;
+	default:        mat_mul_A_BT(&pr->C, &pr->A, &pr->B); break;
+	}
+}
+
+// Seconds per call of the proxy shape `s` with `params`. A proxy that
+// differs from the real shape has no tuned entry, so it is timed through
+// the kernel default instead of polluting the table.
+static double time_params(TuneProblem *pr, const GemmShape *s, GemmParams params, bool exact)
+{
+	if (exact) {
+		mat_gemm_set_params(s->kernel, s->m, s->n, s->p, params);
+	} else {
+		mat_gemm_set_params(s->kernel, 0, 0, 0, params);
+	}
+	problem_run(pr, s->kernel); // warm-up
+
+	int reps = 0;
+	double t0 = tune_seconds();
+	double dt;
+	do {
+		problem_run(pr, s->kernel);
+		reps++;
+		dt = tune_seconds() - t0;
+	} while (dt < TUNE_MIN_SECONDS);
+
+	return dt / reps;
+}
+
+void gemm_autotune(const GemmShape *shapes, int count, int max_threads, const char *cache_path)
+{
+	static const int mcs[] = { 8, 32, 128 };
+	static const int ncs[] = { 64, 256, 1024 };
+	static const int kcs[] = { 64, 256, 1024 };
+
+	if (max_threads < 1) max_threads = 1;
+	if (max_threads > 64) max_threads = 64;
+
+	// peaks for every thread count the sweep can pick
+	double peak_gflops[65] = {0};
+	double peak_gbs[65] = {0};
+	float *bw_buf = (float *)malloc(PEAK_BW_BYTES);
+	if (!bw_buf) {
+		fprintf(stderr, "Failed to allocate bandwidth probe buffer\n");
+		return;
+	}
+	memset(bw_buf, 0, PEAK_BW_BYTES);
+
+	for (int t = 1; t <= max_threads; t *= 2) {
+		peak_gflops[t] = measure_peak_gflops(t);
+		peak_gbs[t] = measure_peak_gbs(bw_buf, t);
+		printf("peak %2d thread(s): %8.2f GFLOP/s | %7.2f GB/s\n", t, peak_gflops[t], peak_gbs[t]);
+	}
+	free(bw_buf);
+
+	Rng rng;
+	rng_seed(&rng, 0, 0);
+
+	printf("%-15s %-13s %5s %6s %6s | %3s %4s %4s %2s | %8s %6s | %7s %6s | %9s\n",
+	       "kernel", "call", "m", "n", "p", "mc", "nc", "kc", "t",
+	       "GFLOP/s", "%peak", "GB/s", "%peak", "roofline");
+
+	for (int i = 0; i < count; ++i) {
+		GemmShape real = shapes[i];
+
+		// time on the same shape with the batch dimension capped; tiles
+		// depend on the weight dims, the batch dim only scales the work
+		GemmShape proxy = real;
+		if (proxy.kernel == GEMM_A_BT || proxy.kernel == GEMM_A_BT_U8) {
+			if (proxy.n > TUNE_MAX_BATCH) proxy.n = TUNE_MAX_BATCH;
+		} else if (proxy.p > TUNE_MAX_BATCH) {
+			proxy.p = TUNE_MAX_BATCH;
+		}
+
+		bool exact = proxy.m == real.m && proxy.n == real.n && proxy.p == real.p;
+		GemmParams dflt = mat_gemm_get_params(real.kernel, 0, 0, 0);
+
+		TuneProblem pr = {0};
+		problem_alloc(&pr, &proxy, &rng);
+
+		// stage 1: tiles on one thread, stage 2: threads with the best tiles
+		GemmParams best = dflt;
+		best.threads = 1;
+		double best_t = time_params(&pr, &proxy, best, exact);
+
+		for (size_t a = 0; a < sizeof(mcs) / sizeof(mcs[0]); ++a) {
+			for (size_t b = 0; b < sizeof(ncs) / sizeof(ncs[0]); ++b) {
+				for (size_t c = 0; c < sizeof(kcs) / sizeof(kcs[0]); ++c) {
+					GemmParams q = { mcs[a], ncs[b], kcs[c], 1 };
+					double t = time_params(&pr, &proxy, q, exact);
+					if (t < best_t) { best_t = t; best = q; }
+				}
+			}
+		}
+		for (int t = 2; t <= max_threads; t *= 2) {
+			GemmParams q = best;
+			q.threads = t;
+			double dt = time_params(&pr, &proxy, q, exact);
+			if (dt < best_t) { best_t = dt; best = q; }
+		}
+
+		mat_gemm_set_params(real.kernel, 0, 0, 0, dflt);
+		mat_gemm_set_params(real.kernel, real.m, real.n, real.p, best);
+
+		double flops = 2.0 * proxy.m * proxy.n * proxy.p;
+		double bytes = (double)sizeof(float) *
+			((double)pr.A.rows * pr.A.cols + (double)pr.B.rows * pr.B.cols + (double)pr.C.rows * pr.C.cols)
+			+ (double)pr.Bq.rows * pr.Bq.cols;
+		double gflops = flops / best_t * 1e-9;
+		double gbs = bytes / best_t * 1e-9;
+
+		int pt = best.threads;
+		while (peak_gflops[pt] == 0.0 && pt > 1) pt--;
+
+		// attainable = min(compute peak, intensity * bandwidth peak)
+		double roof = flops / bytes * peak_gbs[pt];
+		if (roof > peak_gflops[pt]) roof = peak_gflops[pt];
+
+		printf("%-15s %-13s %5d %6d %6d | %3d %4d %4d %2d | %8.2f %5.1f%% | %7.2f %5.1f%% | %9.2f\n",
+		       mat_gemm_name(real.kernel), real.what, real.m, real.n, real.p,
+		       best.mc, best.nc, best.kc, best.threads,
+		       gflops, 100.0 * gflops / peak_gflops[pt],
+		       gbs, 100.0 * gbs / peak_gbs[pt], roof);
+
+		problem_free(&pr);
+	}
+
+	if (cache_path) {
+		if (mat_gemm_save(cache_path)) {
+			printf("gemm tuning saved to %s\n", cache_path);
+		} else {
+			fprintf(stderr, "Failed to write gemm tuning cache %s\n", cache_path);
+		}
+	}
+}
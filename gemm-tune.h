@@ -0,0 +1,20 @@
+// gemm-tune.h - auto-tuner and roofline report for the GEMM kernels
+#pragma once
+
+#include <matrix.h>
+
+typedef struct {
+	GemmKernel kernel;
+	int m, n, p;        // in the kernel's own naming, see GemmKernel
+	const char *what;   // which MLP call issues it
+} GemmShape;
+
+// The GEMM shapes an MLP of these dims runs per training step on chunks of
+// `batch` columns, with fc1 on the _U8 kernels for uint8 inputs; returns
+// the number written to out (at most max).
+int gemm_mlp_shapes(GemmShape *out, int max, int input_dim, int hidden1, int hidden2, int num_classes, int batch, bool u8_input);
+
+// Sweeps tile sizes, then thread counts up to max_threads, for each shape.
+// Winners are installed with mat_gemm_set_params and written to cache_path.
+// Prints achieved vs measured peak FLOP/s and bandwidth per kernel.
+void gemm_autotune(const GemmShape *shapes, int count, int max_threads, const char *cache_path);
@@ -0,0 +1,73 @@
+// lr-schedule.c - learning-rate schedules over (fractional) epochs
+#include <lr-schedule.h>
+
+#include <math.h>
+#include <string.h>
+
+#define ONE_CYCLE_WARMUP 0.3f
+
+static const char *policy_names[LR_POLICIES] = { "constant", "step", "cosine", "onecycle" };
+
+LrSchedule lr_schedule_default(LrPolicy policy, float epochs)
+{
+	LrSchedule s = {
+		.policy = policy,
+		.epochs = epochs,
+		.warmup = 0.0f,
+		.start_scale = policy == LR_ONE_CYCLE ? 0.04f : 0.1f,
+		.final_scale = 1e-3f,
+		.step_every = epochs > 3.0f ? epochs / 3.0f : 1.0f,
+		.gamma = 0.1f,
+	};
+	return s;
+}
+
+float lr_schedule_scale(const LrSchedule *s, float epoch)
+{
+	float warmup = s->warmup;
+	if (s->policy == LR_ONE_CYCLE && warmup <= 0.0f) {
+		warmup = ONE_CYCLE_WARMUP * s->epochs;
+	}
+
+	if (epoch < warmup) {
+		return s->start_scale + (1.0f - s->start_scale) * (epoch / warmup);
+	}
+
+	// position in the decay phase, [0, 1]
+	float span = s->epochs - warmup;
+	float t = span > 0.0f ? (epoch - warmup) / span : 1.0f;
+	if (t > 1.0f) t = 1.0f;
+
+	switch (s->policy) {
+	case LR_STEP:
+		return s->step_every > 0.0f ? powf(s->gamma, floorf(epoch / s->step_every)) : 1.0f;
+	case LR_COSINE:
+		return s->final_scale + (1.0f - s->final_scale) * 0.5f * (1.0f + cosf((float)M_PI * t));
+	case LR_ONE_CYCLE:
+		return 1.0f - (1.0f - s->final_scale) * t;
+	default:
+		return 1.0f;
+	}
+}
+
+const char *lr_policy_name(LrPolicy policy)
+{
+	return (policy >= 0 && policy < LR_POLICIES) ? policy_names[policy] : "?";
+}
+
+bool lr_policy_parse(const char *name, LrPolicy *out)
+{
+	for (int p = 0; p < LR_POLICIES; ++p) {
+		if (strcmp(name, policy_names[p]) == 0) {
+			*out = (LrPolicy)p;
+			return true;
+		}
+	}
+	return false;
+}
+
+float lr_scale_batch(float lr, int batch, int ref_batch)
+{
+	if (batch <= 0 || ref_batch <= 0) return lr;
+	return lr * (float)batch / (float)ref_batch;
+}
@@ -0,0 +1,37 @@
+// lr-schedule.h - learning-rate schedules over (fractional) epochs
+#pragma once
+
+#include <stdbool.h>
+
+typedef enum {
+	LR_CONSTANT,
+	LR_STEP,        // multiply by gamma every step_every epochs
+	LR_COSINE,      // cosine anneal from the peak to final_scale
+	LR_ONE_CYCLE,   // linear ramp up over warmup, linear ramp down to final_scale
+	LR_POLICIES
+} LrPolicy;
+
+typedef struct {
+	LrPolicy policy;
+	float epochs;       // horizon of the decay; usually TrainOptions.epochs
+	float warmup;       // epochs of linear ramp from start_scale to the peak;
+	                    // 0 with LR_ONE_CYCLE means 30% of epochs
+	float start_scale;  // fraction of the peak at epoch 0 of the warmup
+	float final_scale;  // fraction of the peak at the end of the horizon
+	float step_every;   // LR_STEP decay period, in epochs
+	float gamma;        // LR_STEP decay factor
+} LrSchedule;
+
+// Defaults for `policy`: no warmup, floor at 0.1% of the peak, step decay
+// by 0.1 every third of the horizon.
+LrSchedule lr_schedule_default(LrPolicy policy, float epochs);
+
+// Multiplier of the peak lr at `epoch`, where the fractional part is the
+// position inside the epoch (step / steps per epoch).
+float lr_schedule_scale(const LrSchedule *s, float epoch);
+
+const char *lr_policy_name(LrPolicy policy);
+bool lr_policy_parse(const char *name, LrPolicy *out);
+
+// Linear scaling rule: lr tuned at ref_batch, rescaled for batch.
+float lr_scale_batch(float lr, int batch, int ref_batch);
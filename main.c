@@ -1,9 +1,12 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <matrix.h>
 #include <simple-nn.c>
+#include <gemm-tune.h>
 
 static uint32_t read_be_u32(FILE *f)
 {
@@ -18,7 +21,8 @@ static uint32_t read_be_u32(FILE *f)
            (uint32_t)b[3];
 }
 
-Matrix load_mnist_images_idx(const char *path)
+// Images as stored on disk, one byte per pixel, laid out (pixel x sample)
+MatrixU8 load_mnist_images_idx_u8(const char *path)
 {
     FILE *f = fopen(path, "rb");
     if (!f) {
@@ -49,12 +53,16 @@ Matrix load_mnist_images_idx(const char *path)
         exit(1);
     }
 
-    Matrix X = {0};
-    mat_alloc(&X, (int)image_size, (int)count);
+    MatrixU8 X = {0};
+    if (!mat_u8_alloc(&X, (int)image_size, (int)count)) {
+        fprintf(stderr, "Failed to allocate image matrix\n");
+        exit(1);
+    }
 
-    for (uint32_t i = 0; i < count; ++i) {
-        for (size_t j = 0; j < image_size; ++j) {
-            X.data[j + (size_t)i * image_size] = raw[(size_t)i * image_size + j] / 255.0f;
+    // raw is sample-major; X is (pixel x sample)
+    for (size_t j = 0; j < image_size; ++j) {
+        for (uint32_t i = 0; i < count; ++i) {
+            X.data[j * count + i] = raw[(size_t)i * image_size + j];
         }
     }
 
@@ -64,7 +72,24 @@ Matrix load_mnist_images_idx(const char *path)
     return X;
 }
 
-Matrix load_mnist_labels_idx(const char *path)
+Matrix load_mnist_images_idx(const char *path)
+{
+    MatrixU8 raw = load_mnist_images_idx_u8(path);
+
+    Matrix X = {0};
+    mat_alloc(&X, raw.rows, raw.cols);
+
+    size_t n = (size_t)raw.rows * (size_t)raw.cols;
+    for (size_t i = 0; i < n; ++i) {
+        X.data[i] = raw.data[i] / 255.0f;
+    }
+
+    mat_u8_free(&raw);
+
+    return X;
+}
+
+Labels load_mnist_labels_idx(const char *path)
 {
     FILE *f = fopen(path, "rb");
     if (!f) {
@@ -91,11 +116,11 @@ Matrix load_mnist_labels_idx(const char *path)
         exit(1);
     }
 
-    Matrix Y = {0};
-    mat_alloc(&Y, 1, (int)count);
+    Labels Y = {0};
+    labels_alloc(&Y, (int)count);
 
     for (uint32_t i = 0; i < count; ++i) {
-        Y.data[i] = (float)raw[i];
+        Y.data[i] = (int)raw[i];
     }
 
     free(raw);
@@ -108,12 +133,12 @@ Dataset load_mnist_dataset(const char *images_path, const char *labels_path)
 {
     Dataset d = {0};
     d.X_batches = malloc(sizeof(Matrix));
-    d.Y_batches = malloc(sizeof(Matrix));
+    d.Y_batches = malloc(sizeof(Labels));
     d.X_batches[0] = load_mnist_images_idx(images_path);
     d.Y_batches[0] = load_mnist_labels_idx(labels_path);
     d.num_batches = 1;
 
-    if (d.X_batches[0].cols != d.Y_batches[0].cols) {
+    if (d.X_batches[0].cols != d.Y_batches[0].count) {
         fprintf(stderr, "MNIST image/label sample counts do not match\n");
         exit(1);
     }
@@ -121,25 +146,361 @@ Dataset load_mnist_dataset(const char *images_path, const char *labels_path)
     return d;
 }
 
+// Same as load_mnist_dataset, but images stay one byte per pixel; train
+// with mlp_use_u8_input(&mlp, 1.0f / 255.0f).
+Dataset load_mnist_dataset_u8(const char *images_path, const char *labels_path)
+{
+    Dataset d = {0};
+    d.Xq_batches = malloc(sizeof(MatrixU8));
+    d.Y_batches = malloc(sizeof(Labels));
+    d.Xq_batches[0] = load_mnist_images_idx_u8(images_path);
+    d.Y_batches[0] = load_mnist_labels_idx(labels_path);
+    d.num_batches = 1;
+
+    if (d.Xq_batches[0].cols != d.Y_batches[0].count) {
+        fprintf(stderr, "MNIST image/label sample counts do not match\n");
+        exit(1);
+    }
+
+    return d;
+}
+
+// Tunes the GEMM shapes of the MLP built below for chunks of `batch` columns.
+// workers: concurrent callers of the GEMMs (Hogwild! threads), which
+// share the cores between them
+static void tune_gemm(int input_dim, int batch, bool u8_input, int workers, const char *cache_path)
+{
+    GemmShape shapes[16];
+    int count = gemm_mlp_shapes(shapes, 16, input_dim, 128, 64, 10, batch, u8_input);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int per_worker = cpus > 0 ? (int)cpus / workers : 1;
+
+    gemm_autotune(shapes, count, per_worker > 0 ? per_worker : 1, cache_path);
+}
+
+static void start_evaluator(Evaluator *ev, const MLP *m, const Dataset *val)
+{
+    if (!evaluator_init(ev, m, val, 1000)) {
+        fprintf(stderr, "Failed to start the validation evaluator\n");
+        exit(1);
+    }
+}
+
+static void scale_lr(TrainOptions *opts, int batch, int ref_batch)
+{
+    if (ref_batch <= 0) return;
+
+    opts->lr = lr_scale_batch(opts->lr, batch, ref_batch);
+    printf("lr %g for batch %d (linear scaling from batch %d)\n", opts->lr, batch, ref_batch);
+}
+
 int main(int argc, char **argv)
 {
     const char *images_path = "../archive/train-images.idx3-ubyte";
     const char *labels_path = "../archive/train-labels.idx1-ubyte";
 
-    if (argc >= 3) {
-        images_path = argv[1];
-        labels_path = argv[2];
+    // --eval: validation pass on a background thread after every epoch
+    bool eval = false;
+    const char *val_images_path = "../archive/t10k-images.idx3-ubyte";
+    const char *val_labels_path = "../archive/t10k-labels.idx1-ubyte";
+
+    size_t act_budget = 0; // bytes, 0 = keep the whole batch resident
+    uint64_t seed = 1;     // weight init and shuffling
+
+    // --stream: out-of-core training over one or more image/label shard pairs
+    bool stream = false;
+    bool direct = false;
+    bool compact = false; // --u8: keep images as bytes, dequantized inside fc1
+
+    // --hogwild N: N lock-free SGD workers on --batch sized mini-batches;
+    // --hogwild-sweep trains fresh models for 1, 2, 4 .. N workers, with N
+    // defaulting to the cpu count
+    int hogwild = 0;
+
+    // --tune: sweep GEMM blocking/threads for this model, then train;
+    // winners persist in the cache file, which is read on every start
+    bool tune = false;
+    const char *tune_cache = "gemm-tuning.txt";
+
+    // --augment: random shift / rotation / elastic warps, fresh every epoch
+    bool augment = false;
+    Augment aug = {
+        .width = 28,
+        .height = 28,
+        .max_shift = 2.0f,
+        .max_rotate = 10.0f,
+        .elastic = 1.0f,
+        .threads = 2,
+    };
+    // --schedule: lr policy (constant, step, cosine, onecycle) over --epochs,
+    // peaking at --lr; --lr-ref-batch N rescales --lr linearly from batch N
+    // to the batch actually trained on
+    int epochs = 40;
+    float lr = 0.1f;
+    bool scheduled = false;
+    LrSchedule sched = lr_schedule_default(LR_CONSTANT, 0.0f);
+    float warmup = 0.0f;
+    int lr_ref_batch = 0;
+
+    // --patience N: stop once val loss has not improved for N evaluations;
+    // --target-acc P: report the time to P% val accuracy
+    int patience = 0;
+    float min_delta = 0.0f;
+    float target_acc = 0.0f;
+
+    bool hogwild_sweep = false;
+    int batch = 256;
+    int shuffle_buffer = 8192;
+
+    const char *paths[2 * 64];
+    int positional = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--act-budget-mb") == 0 && i + 1 < argc) {
+            act_budget = (size_t)atol(argv[++i]) << 20;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--eval") == 0) {
+            eval = true;
+        } else if (strcmp(argv[i], "--val-images") == 0 && i + 1 < argc) {
+            val_images_path = argv[++i];
+            eval = true;
+        } else if (strcmp(argv[i], "--val-labels") == 0 && i + 1 < argc) {
+            val_labels_path = argv[++i];
+            eval = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[i], "--u8") == 0) {
+            compact = true;
+        } else if (strcmp(argv[i], "--hogwild") == 0 && i + 1 < argc) {
+            hogwild = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hogwild-sweep") == 0) {
+            hogwild_sweep = true;
+        } else if (strcmp(argv[i], "--augment") == 0) {
+            augment = true;
+        } else if (strcmp(argv[i], "--augment-threads") == 0 && i + 1 < argc) {
+            aug.threads = atoi(argv[++i]);
+            augment = true;
+        } else if (strcmp(argv[i], "--tune") == 0) {
+            tune = true;
+        } else if (strcmp(argv[i], "--tune-cache") == 0 && i + 1 < argc) {
+            tune_cache = argv[++i];
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            direct = true;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shuffle-buffer") == 0 && i + 1 < argc) {
+            shuffle_buffer = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--epochs") == 0 && i + 1 < argc) {
+            epochs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--lr") == 0 && i + 1 < argc) {
+            lr = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--schedule") == 0 && i + 1 < argc) {
+            if (!lr_policy_parse(argv[++i], &sched.policy)) {
+                fprintf(stderr, "Unknown lr schedule: %s\n", argv[i]);
+                return 1;
+            }
+            scheduled = true;
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = strtof(argv[++i], NULL);
+            scheduled = true;
+        } else if (strcmp(argv[i], "--lr-ref-batch") == 0 && i + 1 < argc) {
+            lr_ref_batch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--patience") == 0 && i + 1 < argc) {
+            patience = atoi(argv[++i]);
+            eval = true;
+        } else if (strcmp(argv[i], "--min-delta") == 0 && i + 1 < argc) {
+            min_delta = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--target-acc") == 0 && i + 1 < argc) {
+            target_acc = strtof(argv[++i], NULL) / 100.0f;
+            eval = true;
+        } else if (argv[i][0] != '-' && positional < 2 * 64) {
+            paths[positional++] = argv[i];
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
     }
 
-    Dataset train = load_mnist_dataset(images_path, labels_path);
+    if (positional >= 2) {
+        images_path = paths[0];
+        labels_path = paths[1];
+    }
+
+    // --hogwild-sweep alone sweeps up to one worker per core
+    if (hogwild_sweep && hogwild <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        hogwild = cpus > 0 ? (int)cpus : 1;
+        printf("hogwild sweep up to %d workers (cpu count)\n", hogwild);
+    }
+
+    // the stream and Hogwild! loops never call the augmenter
+    if (augment && (stream || hogwild > 0)) {
+        fprintf(stderr, "--augment is only supported for in-memory full-batch training\n");
+        return 1;
+    }
+
+    if (mat_gemm_load(tune_cache)) {
+        printf("gemm tuning loaded from %s\n", tune_cache);
+    }
+
+    TrainOptions opts = {
+        .epochs = epochs,
+        .lr = lr,
+        .seed = seed,
+        .patience = patience,
+        .min_delta = min_delta,
+        .target_acc = target_acc,
+    };
+
+    if (scheduled) {
+        LrPolicy policy = sched.policy;
+        sched = lr_schedule_default(policy, (float)epochs);
+        sched.warmup = warmup;
+        opts.schedule = &sched;
+        printf("lr schedule: %s, %.1f warmup epochs over %d\n", lr_policy_name(policy), warmup, epochs);
+    }
+
+    if (augment) {
+        aug.seed = seed;
+        opts.augment = &aug;
+    }
+
+    Dataset val = {0};
+    Evaluator evaluator;
+
+    if (eval) {
+        val = compact ? load_mnist_dataset_u8(val_images_path, val_labels_path)
+                      : load_mnist_dataset(val_images_path, val_labels_path);
+    }
+
+    if (stream) {
+        // shards are given as image/label pairs
+        const char *image_paths[64];
+        const char *label_paths[64];
+        int num_shards = 0;
+
+        if (positional < 2) {
+            image_paths[num_shards] = images_path;
+            label_paths[num_shards++] = labels_path;
+        }
+        for (int i = 0; i + 1 < positional; i += 2) {
+            image_paths[num_shards] = paths[i];
+            label_paths[num_shards++] = paths[i + 1];
+        }
+
+        MnistStream s;
+        mnist_stream_open(&s, image_paths, label_paths, num_shards, batch, shuffle_buffer, direct);
+
+        MLP mlp;
+        mlp_init_ex(&mlp, s.image_size, 128, 64, 10, batch, act_budget, seed);
+        if (compact) {
+            mlp_use_u8_input(&mlp, 1.0f / 255.0f);
+        }
+        if (tune) {
+            tune_gemm(s.image_size, mlp.chunk, compact, 1, tune_cache);
+        }
+
+        if (eval) {
+            start_evaluator(&evaluator, &mlp, &val);
+            opts.eval = &evaluator;
+        }
+
+        printf("streaming %d shard(s), batch %d, shuffle buffer %d\n", num_shards, batch, shuffle_buffer);
+        scale_lr(&opts, batch, lr_ref_batch);
+        mlp_train_stream(&mlp, &s, &opts);
+
+        if (eval) {
+            evaluator_free(&evaluator);
+        }
+        mnist_stream_close(&s);
+        return 0;
+    }
+
+    Dataset train = compact ? load_mnist_dataset_u8(images_path, labels_path)
+                            : load_mnist_dataset(images_path, labels_path);
+
+    int x_rows = compact ? train.Xq_batches[0].rows : train.X_batches[0].rows;
+    int x_cols = compact ? train.Xq_batches[0].cols : train.X_batches[0].cols;
+
+    if (hogwild > 0) {
+        int max_threads = hogwild;
+
+        if (tune) {
+            tune_gemm(x_rows, batch, compact, max_threads, tune_cache);
+        }
+        scale_lr(&opts, batch, lr_ref_batch);
+
+        float losses[32];
+        double seconds[32];
+        int counts[32];
+        int runs = 0;
+
+        // sweep: 1, 2, 4 .. below N, then N itself
+        for (int t = hogwild_sweep ? 1 : max_threads; runs < 32; t = (2 * t < max_threads) ? 2 * t : max_threads) {
+            // same seed for every run, so only the worker count differs
+            MLP mlp;
+            mlp_init_ex(&mlp, x_rows, 128, 64, 10, batch, 0, seed);
+            if (compact) {
+                mlp_use_u8_input(&mlp, 1.0f / 255.0f);
+            }
+            if (eval) {
+                start_evaluator(&evaluator, &mlp, &val);
+                opts.eval = &evaluator;
+            }
+
+            double t0 = now_seconds();
+            losses[runs] = mlp_train_hogwild(&mlp, &train, &opts, t, batch);
+            seconds[runs] = now_seconds() - t0;
+            counts[runs] = t;
+            runs++;
+
+            if (eval) {
+                evaluator_free(&evaluator);
+            }
+            mlp_free(&mlp);
+
+            if (t >= max_threads) break;
+        }
+
+        if (hogwild_sweep) {
+            printf("threads | final loss | seconds | speedup\n");
+            for (int r = 0; r < runs; ++r) {
+                printf("%7d | %10.4f | %7.2f | %6.2fx\n", counts[r], losses[r], seconds[r], seconds[0] / seconds[r]);
+            }
+        }
+        return 0;
+    }
 
     MLP mlp;
-    mlp_init(&mlp, train.X_batches[0].rows, 128, 64, 10, train.X_batches[0].cols);
+    mlp_init_ex(&mlp, x_rows, 128, 64, 10, x_cols, act_budget, seed);
+    if (compact) {
+        mlp_use_u8_input(&mlp, 1.0f / 255.0f);
+    }
 
-    printf("X shape: rows = %d, cols = %d\n", train.X_batches[0].rows, train.X_batches[0].cols);
-    printf("Y shape: rows = %d, cols = %d\n", train.Y_batches[0].rows, train.Y_batches[0].cols);
+    if (tune) {
+        tune_gemm(x_rows, mlp.chunk, compact, 1, tune_cache);
+    }
 
-    mlp_train(&mlp, &train, 40, 0.1f);
+    if (mlp.chunk < mlp.max_batch) {
+        printf("activation budget: %zu MB -> %d columns per chunk\n", act_budget >> 20, mlp.chunk);
+    }
+
+    printf("X shape: rows = %d, cols = %d%s\n", x_rows, x_cols, compact ? " (uint8)" : "");
+    printf("Y: %d labels\n", train.Y_batches[0].count);
+
+    if (eval) {
+        start_evaluator(&evaluator, &mlp, &val);
+        opts.eval = &evaluator;
+    }
+
+    // every step sees the whole dataset
+    scale_lr(&opts, x_cols, lr_ref_batch);
+    mlp_train_opts(&mlp, &train, &opts);
+
+    if (eval) {
+        evaluator_free(&evaluator);
+    }
 
     return 0;
 }
@@ -1,6 +1,345 @@
 // nn-matrix.c - minimal matrix library implementation
 #include <matrix.h>
 #include <string.h>
+#include <pthread.h>
+
+/* =========================
+   Blocked, threaded GEMM kernels
+   ========================= */
+
+#define GEMM_MAX_THREADS 64
+#define GEMM_MAX_TUNED 64
+
+// used when no tuned entry matches the shape
+static GemmParams gemm_defaults[GEMM_KERNELS] = {
+	{ 64, 256, 256, 1 }, // GEMM_AB
+	{ 64, 256, 256, 1 }, // GEMM_AT_B
+	{ 16, 64, 1024, 1 }, // GEMM_A_BT
+	{ 64, 256, 256, 1 }, // GEMM_AB_U8
+	{ 16, 64, 1024, 1 }, // GEMM_A_BT_U8
+};
+
+static struct {
+	GemmKernel kernel;
+	int m, n, p;
+	GemmParams params;
+} gemm_tuned[GEMM_MAX_TUNED];
+static int gemm_num_tuned;
+
+// per calling thread, see mat_gemm_limit_threads
+static _Thread_local int gemm_thread_cap;
+
+static const char *gemm_names[GEMM_KERNELS] = {
+	"mat_mul", "mat_mul_AT_B", "mat_mul_A_BT", "mat_mul_u8", "mat_mul_A_BT_u8"
+};
+
+typedef struct {
+	GemmKernel kernel;
+	Matrix *C;
+	const Matrix *A;
+	const Matrix *B;
+	const MatrixU8 *Bq; // B of the _U8 kernels, dequantized by alpha
+	float alpha;
+	bool accumulate;   // C += alpha * op, otherwise C = alpha * op
+	GemmParams params;
+	int r0, r1;        // rows of C owned by this worker
+} GemmTask;
+
+static inline int imin(int a, int b) { return a < b ? a : b; }
+
+static void gemm_zero_rows(const GemmTask *t)
+{
+	if (t->accumulate || t->r1 <= t->r0) return;
+	memset(t->C->data + (size_t)t->r0 * t->C->cols, 0,
+	       (size_t)(t->r1 - t->r0) * t->C->cols * sizeof(float));
+}
+
+// Widens rows [r0, r1) x cols [c0, c1) of a uint8 operand into a dense
+// float panel, so the conversion is paid once per block instead of once
+// per row of A that reuses it.
+static void gemm_widen_u8(float *panel, const MatrixU8 *B, int r0, int r1, int c0, int c1)
+{
+	int w = c1 - c0;
+	for (int r = r0; r < r1; ++r) {
+		const unsigned char *src = B->data + (size_t)r * B->cols + c0;
+		float *dst = panel + (size_t)(r - r0) * w;
+		for (int c = 0; c < w; ++c) {
+			dst[c] = (float)src[c];
+		}
+	}
+}
+
+// Panel for one (kc x nc) block of a uint8 B, NULL for float kernels.
+static float *gemm_panel_alloc(const GemmTask *t, int rows, int cols)
+{
+	if (!t->Bq) return NULL;
+
+	float *panel = (float *)malloc((size_t)rows * cols * sizeof(float));
+	if (!panel) {
+		fprintf(stderr, "Failed to allocate GEMM panel\n");
+		exit(1);
+	}
+	return panel;
+}
+
+// C (m x p) = A (m x n) · B (n x p)
+static void gemm_ab_rows(const GemmTask *t)
+{
+	int n = t->A->cols;
+	int p = t->Bq ? t->Bq->cols : t->B->cols;
+	int mc = t->params.mc, nc = t->params.nc, kc = t->params.kc;
+	float *panel = gemm_panel_alloc(t, imin(kc, n), imin(nc, p));
+
+	gemm_zero_rows(t);
+
+	for (int i0 = t->r0; i0 < t->r1; i0 += mc) {
+		for (int k0 = 0; k0 < n; k0 += kc) {
+			for (int j0 = 0; j0 < p; j0 += nc) {
+				int i1 = imin(i0 + mc, t->r1), k1 = imin(k0 + kc, n), j1 = imin(j0 + nc, p);
+
+				// uint8 B: read the block from its widened copy
+				const float *b_base = t->Bq ? panel : t->B->data + (size_t)k0 * p + j0;
+				size_t b_stride = t->Bq ? (size_t)(j1 - j0) : (size_t)p;
+				if (t->Bq) gemm_widen_u8(panel, t->Bq, k0, k1, j0, j1);
+
+				for (int i = i0; i < i1; ++i) {
+					float *c = t->C->data + (size_t)i * p + j0;
+					for (int k = k0; k < k1; ++k) {
+						float a = t->alpha * t->A->data[(size_t)i * n + k];
+						const float *b = b_base + (size_t)(k - k0) * b_stride;
+						for (int j = 0; j < j1 - j0; ++j) {
+							c[j] += a * b[j];
+						}
+					}
+				}
+			}
+		}
+	}
+
+	free(panel);
+}
+
+// C (n x p) = A^T · B, A (m x n), B (m x p)
+static void gemm_at_b_rows(const GemmTask *t)
+{
+	int m = t->A->rows;
+	int n = t->A->cols;
+	int p = t->B->cols;
+	int mc = t->params.mc, nc = t->params.nc, kc = t->params.kc;
+
+	gemm_zero_rows(t);
+
+	for (int i0 = t->r0; i0 < t->r1; i0 += mc) {
+		for (int k0 = 0; k0 < m; k0 += kc) {
+			for (int j0 = 0; j0 < p; j0 += nc) {
+				int i1 = imin(i0 + mc, t->r1), k1 = imin(k0 + kc, m), j1 = imin(j0 + nc, p);
+
+				for (int i = i0; i < i1; ++i) {
+					float *c = t->C->data + (size_t)i * p;
+					for (int k = k0; k < k1; ++k) {
+						float a = t->alpha * t->A->data[(size_t)k * n + i];
+						const float *b = t->B->data + (size_t)k * p;
+						for (int j = j0; j < j1; ++j) {
+							c[j] += a * b[j];
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+// C (m x p) = A · B^T, A (m x n), B (p x n)
+static void gemm_a_bt_rows(const GemmTask *t)
+{
+	int n = t->A->cols;
+	int p = t->Bq ? t->Bq->rows : t->B->rows;
+	int mc = t->params.mc, nc = t->params.nc, kc = t->params.kc;
+	float *panel = gemm_panel_alloc(t, imin(nc, p), imin(kc, n));
+
+	gemm_zero_rows(t);
+
+	for (int i0 = t->r0; i0 < t->r1; i0 += mc) {
+		for (int j0 = 0; j0 < p; j0 += nc) {
+			for (int k0 = 0; k0 < n; k0 += kc) {
+				int i1 = imin(i0 + mc, t->r1), j1 = imin(j0 + nc, p), k1 = imin(k0 + kc, n);
+
+				// uint8 B: read the block from its widened copy
+				const float *b_base = t->Bq ? panel : t->B->data + (size_t)j0 * n + k0;
+				size_t b_stride = t->Bq ? (size_t)(k1 - k0) : (size_t)n;
+				if (t->Bq) gemm_widen_u8(panel, t->Bq, j0, j1, k0, k1);
+
+				for (int i = i0; i < i1; ++i) {
+					const float *a = t->A->data + (size_t)i * n + k0;
+					for (int j = j0; j < j1; ++j) {
+						const float *b = b_base + (size_t)(j - j0) * b_stride;
+						int kw = k1 - k0;
+
+						// 8 partial sums give the vectorizer independent lanes
+						float acc[8] = {0};
+						int k = 0;
+						for (; k + 8 <= kw; k += 8) {
+							for (int l = 0; l < 8; ++l) {
+								acc[l] += a[k + l] * b[k + l];
+							}
+						}
+						float sum = 0.0f;
+						for (; k < kw; ++k) {
+							sum += a[k] * b[k];
+						}
+						for (int l = 0; l < 8; ++l) {
+							sum += acc[l];
+						}
+						t->C->data[(size_t)i * p + j] += t->alpha * sum;
+					}
+				}
+			}
+		}
+	}
+
+	free(panel);
+}
+
+static void *gemm_worker(void *arg)
+{
+	const GemmTask *t = (const GemmTask *)arg;
+
+	switch (t->kernel) {
+	case GEMM_AB:
+	case GEMM_AB_U8:   gemm_ab_rows(t); break;
+	case GEMM_AT_B:    gemm_at_b_rows(t); break;
+	case GEMM_A_BT:
+	case GEMM_A_BT_U8: gemm_a_bt_rows(t); break;
+	default: break;
+	}
+
+	return NULL;
+}
+
+// Splits the rows of C across params.threads workers (the caller runs the first).
+static void gemm_run(GemmKernel kernel, Matrix *C, const Matrix *A, const Matrix *B, const MatrixU8 *Bq,
+                     float alpha, bool accumulate, int m, int n, int p)
+{
+	GemmParams params = mat_gemm_get_params(kernel, m, n, p);
+	int rows = C->rows;
+	int threads = params.threads;
+
+	if (gemm_thread_cap > 0 && threads > gemm_thread_cap) threads = gemm_thread_cap;
+	if (threads > GEMM_MAX_THREADS) threads = GEMM_MAX_THREADS;
+	if (threads > rows) threads = rows;
+	if (threads < 1) threads = 1;
+
+	GemmTask tasks[GEMM_MAX_THREADS];
+	pthread_t tids[GEMM_MAX_THREADS];
+
+	for (int t = 0; t < threads; ++t) {
+		tasks[t] = (GemmTask){ kernel, C, A, B, Bq, alpha, accumulate, params,
+		                       (int)((long)rows * t / threads),
+		                       (int)((long)rows * (t + 1) / threads) };
+	}
+
+	int spawned = 1;
+	for (; spawned < threads; ++spawned) {
+		if (pthread_create(&tids[spawned], NULL, gemm_worker, &tasks[spawned]) != 0) break;
+	}
+	gemm_worker(&tasks[0]);
+	for (int t = spawned; t < threads; ++t) {
+		gemm_worker(&tasks[t]); // thread creation failed: finish inline
+	}
+	for (int t = 1; t < spawned; ++t) {
+		pthread_join(tids[t], NULL);
+	}
+}
+
+void mat_gemm_limit_threads(int max_threads)
+{
+	gemm_thread_cap = max_threads;
+}
+
+GemmParams mat_gemm_get_params(GemmKernel kernel, int m, int n, int p)
+{
+	for (int i = 0; i < gemm_num_tuned; ++i) {
+		if (gemm_tuned[i].kernel == kernel &&
+		    gemm_tuned[i].m == m && gemm_tuned[i].n == n && gemm_tuned[i].p == p) {
+			return gemm_tuned[i].params;
+		}
+	}
+	return gemm_defaults[kernel];
+}
+
+void mat_gemm_set_params(GemmKernel kernel, int m, int n, int p, GemmParams params)
+{
+	if (params.mc < 1 || params.nc < 1 || params.kc < 1 || params.threads < 1) return;
+
+	if (m == 0 && n == 0 && p == 0) {
+		gemm_defaults[kernel] = params;
+		return;
+	}
+
+	for (int i = 0; i < gemm_num_tuned; ++i) {
+		if (gemm_tuned[i].kernel == kernel &&
+		    gemm_tuned[i].m == m && gemm_tuned[i].n == n && gemm_tuned[i].p == p) {
+			gemm_tuned[i].params = params;
+			return;
+		}
+	}
+
+	if (gemm_num_tuned == GEMM_MAX_TUNED) return;
+	gemm_tuned[gemm_num_tuned].kernel = kernel;
+	gemm_tuned[gemm_num_tuned].m = m;
+	gemm_tuned[gemm_num_tuned].n = n;
+	gemm_tuned[gemm_num_tuned].p = p;
+	gemm_tuned[gemm_num_tuned].params = params;
+	gemm_num_tuned++;
+}
+
+const char *mat_gemm_name(GemmKernel kernel)
+{
+	return (kernel >= 0 && kernel < GEMM_KERNELS) ? gemm_names[kernel] : "?";
+}
+
+// Tuning cache: one "kernel m n p mc nc kc threads" line per tuned shape.
+bool mat_gemm_load(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) return false;
+
+	char line[256];
+	char name[32];
+	int m, n, p;
+	GemmParams params;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#') continue;
+		if (sscanf(line, "%31s %d %d %d %d %d %d %d", name, &m, &n, &p,
+		           &params.mc, &params.nc, &params.kc, &params.threads) != 8) continue;
+
+		for (int k = 0; k < GEMM_KERNELS; ++k) {
+			if (strcmp(name, gemm_names[k]) == 0) {
+				mat_gemm_set_params((GemmKernel)k, m, n, p, params);
+			}
+		}
+	}
+
+	fclose(f);
+	return true;
+}
+
+bool mat_gemm_save(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) return false;
+
+	fprintf(f, "# kernel m n p mc nc kc threads\n");
+	for (int i = 0; i < gemm_num_tuned; ++i) {
+		const GemmParams *q = &gemm_tuned[i].params;
+		fprintf(f, "%s %d %d %d %d %d %d %d\n", gemm_names[gemm_tuned[i].kernel],
+		        gemm_tuned[i].m, gemm_tuned[i].n, gemm_tuned[i].p,
+		        q->mc, q->nc, q->kc, q->threads);
+	}
+
+	return fclose(f) == 0;
+}
 
 void mat_zero(Matrix *m)
 {
@@ -79,6 +418,38 @@ void mat_sum_cols(Matrix* dst, const Matrix* src)
 	}
 }
 
+void mat_sum_cols_acc(Matrix *dst, const Matrix *src, float alpha)
+{
+	if (!dst || !src || !dst->data || !src->data) return;
+	if (dst->rows != src->rows || dst->cols != 1) return;
+
+	for (int i = 0; i < dst->rows; i++)
+	{
+		float sum = 0.0f;
+
+		for (int j = 0; j < src->cols; j++)
+		{
+			sum += src->data[i*src->cols + j];
+		}
+
+		dst->data[i] += alpha * sum;
+	}
+}
+
+void mat_copy_cols(Matrix *dst, const Matrix *src, int col0)
+{
+	if (!dst || !src || !dst->data || !src->data) return;
+	if (dst->rows != src->rows) return;
+	if (col0 < 0 || col0 + dst->cols > src->cols) return;
+
+	// columns are samples, so a column range is one strided run per row
+	for (int r = 0; r < dst->rows; ++r) {
+		memcpy(dst->data + (size_t)r * dst->cols,
+		       src->data + (size_t)r * src->cols + col0,
+		       (size_t)dst->cols * sizeof(float));
+	}
+}
+
 Matrix* mat_mul_AT_B(Matrix *product, const Matrix *first, const Matrix *second)
 {
     if (!product || !first || !second) return NULL;
@@ -91,46 +462,27 @@ Matrix* mat_mul_AT_B(Matrix *product, const Matrix *first, const Matrix *second)
     if (product->rows != first->cols) return NULL;
     if (product->cols != second->cols) return NULL;
 
-    int m = first->rows;
-    int n = first->cols;
-    int p = second->cols;
-
-    for (int i = 0; i < n; i++) {          // rows of first
-        for (int j = 0; j < p; j++) {      // cols of second
-
-            float sum = 0.0f;
-
-            for (int k = 0; k < m; k++) {  // rows of first or second
-                sum += first->data[k * n + i] * second->data[k * p + j]; 
-            }
-
-            product->data[i * p + j] = sum;
-        }
-    }
+    gemm_run(GEMM_AT_B, product, first, second, NULL, 1.0f, false,
+             first->rows, first->cols, second->cols);
 
     return product;
 }
 
 Matrix* mat_mul(Matrix *product, const Matrix *first, const Matrix *second)
 {
-	// TODO: use optimizations like BLAS SIMD
-	if(first->cols != second->rows) return NULL;
-	if( (product->rows != first->rows) && (product->cols != second->cols)  ) return NULL;
-
-    for (int i = 0; i < first->rows; i++) {
-        for (int j = 0; j < second->cols; j++) {
+	if (!product || !first || !second) return NULL;
+	if (!product->data || !first->data || !second->data) return NULL;
 
-            float sum = 0.0f;
-
-            for (int k = 0; k < first->cols; k++) {
-                sum += first->data[i * first->cols + k] * second->data[k * second->cols + j];
-            }
+	// first:  (m x n)
+	// second: (n x p)
+	// product:(m x p)
+	if(first->cols != second->rows) return NULL;
+	if( (product->rows != first->rows) || (product->cols != second->cols)  ) return NULL;
 
-            product->data[i * second->cols + j] = sum;
-        }
-    }
+	gemm_run(GEMM_AB, product, first, second, NULL, 1.0f, false,
+	         first->rows, first->cols, second->cols);
 
-    return product;
+	return product;
 }
 
 Matrix* mat_add(Matrix *product, const Matrix *first, const Matrix *second)
@@ -177,25 +529,20 @@ void mat_mul_A_BT(Matrix *C, const Matrix *A, const Matrix *B)
     if (A->cols != B->cols) return;
     if (C->rows != A->rows || C->cols != B->rows) return;
 
-    int m = A->rows;
-    int n = A->cols;
-    int p = B->rows;
-
-    // Compute C[i,j] = sum_k A[i,k] * B[j,k]
-    for (int i = 0; i < m; ++i) {
-        for (int j = 0; j < p; ++j) {
+    // C[i,j] = sum_k A[i,k] * B[j,k]
+    gemm_run(GEMM_A_BT, C, A, B, NULL, 1.0f, false, A->rows, A->cols, B->rows);
+}
 
-            float sum = 0.0f;
+void mat_mul_A_BT_acc(Matrix *C, const Matrix *A, const Matrix *B, float alpha)
+{
+    if (!A || !B || !C) return;
+    if (!A->data || !B->data || !C->data) return;
 
-            // Inner dot product between:
-            // row i of A  and  row j of B
-            for (int k = 0; k < n; ++k) {
-                sum += A->data[i * n + k] * B->data[j * n + k];
-            }
+    // A: (m x n), B: (p x n), C: (m x p)
+    if (A->cols != B->cols) return;
+    if (C->rows != A->rows || C->cols != B->rows) return;
 
-            C->data[i * p + j] = sum;
-        }
-    }
+    gemm_run(GEMM_A_BT, C, A, B, NULL, alpha, true, A->rows, A->cols, B->rows);
 }
 
 bool mat_alloc(Matrix *m, int r, int c) 
@@ -206,15 +553,11 @@ bool mat_alloc(Matrix *m, int r, int c)
     return m->data != NULL;
 }
 
-void mat_rand_uniform(Matrix *m, float min, float max)
+void mat_rand_uniform(Matrix *m, Rng *rng, float min, float max)
 {
-	size_t n = (size_t)m->rows * (size_t)m->cols;
+	if (!m || !m->data) return;
 
-	for(size_t i = 0; i < n; i++)
-	{
-		// (float)rand() / (float)RAND_MAX) to normalize between 0 and 1
-		m->data[i] = ((float)rand() / (float)RAND_MAX) * (max - min) + min;
-	}
+	rng_fill_uniform(rng, m->data, (size_t)m->rows * (size_t)m->cols, min, max);
 }
 
 void mat_add_bias_cols(Matrix *dst, const Matrix *bias)
@@ -228,4 +571,90 @@ void mat_add_bias_cols(Matrix *dst, const Matrix *bias)
 			dst->data[row * dst->cols + col] += bias->data[row];
 		}
 	}
-}
\ No newline at end of file
+}
+
+bool mat_u8_alloc(MatrixU8 *m, int r, int c)
+{
+	m->rows = r;
+	m->cols = c;
+	m->data = (unsigned char*)malloc((size_t)r * c);
+	return m->data != NULL;
+}
+
+void mat_u8_free(MatrixU8 *m)
+{
+	if(!m || !m->data) return;
+	free(m->data);
+}
+
+void mat_u8_copy(MatrixU8 *dst, const MatrixU8 *src)
+{
+	if (!dst || !src || !dst->data || !src->data) return;
+	if (dst->rows != src->rows || dst->cols != src->cols) return;
+
+	memcpy(dst->data, src->data, (size_t)src->rows * (size_t)src->cols);
+}
+
+void mat_u8_copy_cols(MatrixU8 *dst, const MatrixU8 *src, int col0)
+{
+	if (!dst || !src || !dst->data || !src->data) return;
+	if (dst->rows != src->rows) return;
+	if (col0 < 0 || col0 + dst->cols > src->cols) return;
+
+	for (int r = 0; r < dst->rows; ++r) {
+		memcpy(dst->data + (size_t)r * dst->cols,
+		       src->data + (size_t)r * src->cols + col0,
+		       (size_t)dst->cols);
+	}
+}
+
+Matrix* mat_mul_u8(Matrix *product, const Matrix *first, const MatrixU8 *second, float scale)
+{
+	if (!product || !first || !second) return NULL;
+	if (!product->data || !first->data || !second->data) return NULL;
+
+	// first:  (m x n) float
+	// second: (n x p) uint8
+	// product:(m x p)
+	if (first->cols != second->rows) return NULL;
+	if (product->rows != first->rows || product->cols != second->cols) return NULL;
+
+	// the dequantization scale rides along as alpha
+	gemm_run(GEMM_AB_U8, product, first, NULL, second, scale, false,
+	         first->rows, first->cols, second->cols);
+
+	return product;
+}
+
+void mat_mul_A_BT_u8_acc(Matrix *C, const Matrix *A, const MatrixU8 *B, float alpha)
+{
+	if (!A || !B || !C) return;
+	if (!A->data || !B->data || !C->data) return;
+
+	// A: (m x n) float, B: (p x n) uint8, C: (m x p)
+	if (A->cols != B->cols) return;
+	if (C->rows != A->rows || C->cols != B->rows) return;
+
+	gemm_run(GEMM_A_BT_U8, C, A, NULL, B, alpha, true, A->rows, A->cols, B->rows);
+}
+
+bool labels_alloc(Labels *l, int count)
+{
+	l->count = count;
+	l->data = (int*)malloc((size_t)count * sizeof(int));
+	return l->data != NULL;
+}
+
+void labels_free(Labels *l)
+{
+	if(!l || !l->data) return;
+	free(l->data);
+}
+
+void labels_copy_range(Labels *dst, const Labels *src, int first)
+{
+	if (!dst || !src || !dst->data || !src->data) return;
+	if (first < 0 || first + dst->count > src->count) return;
+
+	memcpy(dst->data, src->data + first, (size_t)dst->count * sizeof(int));
+}
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <rng.h>
 
 typedef struct {
 	int rows;
@@ -11,6 +12,37 @@ typedef struct {
 	float *data; // row-major, contiguous: data[r*cols + c]
 } Matrix;
 
+typedef struct {
+	int rows;
+	int cols;
+	unsigned char *data; // same layout as Matrix, used for compact 8-bit inputs
+} MatrixU8;
+
+typedef struct {
+	int count;
+	int *data; // class id per sample column
+} Labels;
+
+// GEMM kernels whose blocking and threading can be tuned per shape. Shapes
+// use each kernel's own naming: mat_mul A (m x n)·B (n x p), mat_mul_AT_B
+// A (m x n)^T·B (m x p), mat_mul_A_BT A (m x n)·B (p x n)^T. The _U8
+// kernels are the same with a uint8 B.
+typedef enum {
+	GEMM_AB,
+	GEMM_AT_B,
+	GEMM_A_BT,
+	GEMM_AB_U8,
+	GEMM_A_BT_U8,
+	GEMM_KERNELS
+} GemmKernel;
+
+typedef struct {
+	int mc;       // rows of C per block
+	int nc;       // cols of C per block
+	int kc;       // depth of the reduction per block
+	int threads;  // workers splitting the rows of C
+} GemmParams;
+
 
 void mat_zero(Matrix *m); //sets all elements in matrix to 0
 void mat_fill(Matrix *m, float v); //fills all elements of the matrix with value v 
@@ -21,8 +53,11 @@ void mat_scale(Matrix* m, float scalar); // scale a matrix by some scalar
 void mat_sub(Matrix *A, const Matrix *B); // subtracts two matricies elemt wise
 void mat_sum_cols(Matrix* dst, const Matrix* src); // add each col of src to row of dst
 void mat_mul_A_BT(Matrix *C, const Matrix *A, const Matrix *B);
+void mat_mul_A_BT_acc(Matrix *C, const Matrix *A, const Matrix *B, float alpha); // C += alpha * A·B^T
+void mat_sum_cols_acc(Matrix *dst, const Matrix *src, float alpha); // dst += alpha * (row sums of src)
+void mat_copy_cols(Matrix *dst, const Matrix *src, int col0); // dst = src[:, col0 : col0 + dst->cols]
 void mat_free(Matrix *m); // free memory
-void mat_rand_uniform(Matrix *m, float min, float max); // fills m with random values ranging from min to max
+void mat_rand_uniform(Matrix *m, Rng *rng, float min, float max); // fills m with random values ranging from min to max
 void mat_add_bias_cols(Matrix *dst, const Matrix *bias);
 
 bool mat_alloc(Matrix *m, int r, int c);
@@ -32,3 +67,21 @@ Matrix* mat_mul(Matrix *product, const Matrix *first, const Matrix *second); //
 Matrix* mat_add(Matrix *product, const Matrix *first, const Matrix *second); // adds two matricies
 Matrix* mat_div(Matrix *m, float scalar); // divides each element by scalar
 Matrix* mat_mul_AT_B(Matrix *product, const Matrix *first, const Matrix *second); // A: (m x n) -> A^T: (n x m), B: (m x p), C: (n x p)
+
+bool mat_u8_alloc(MatrixU8 *m, int r, int c);
+void mat_u8_free(MatrixU8 *m);
+void mat_u8_copy(MatrixU8 *dst, const MatrixU8 *src);
+void mat_u8_copy_cols(MatrixU8 *dst, const MatrixU8 *src, int col0); // dst = src[:, col0 : col0 + dst->cols]
+Matrix* mat_mul_u8(Matrix *product, const Matrix *first, const MatrixU8 *second, float scale); // product = scale * first·second, dequantized in the inner loop
+void mat_mul_A_BT_u8_acc(Matrix *C, const Matrix *A, const MatrixU8 *B, float alpha); // C += alpha * A·B^T
+
+GemmParams mat_gemm_get_params(GemmKernel kernel, int m, int n, int p);
+void mat_gemm_set_params(GemmKernel kernel, int m, int n, int p, GemmParams params); // m = n = p = 0 sets the kernel's default
+const char *mat_gemm_name(GemmKernel kernel);
+void mat_gemm_limit_threads(int max_threads); // caps GEMM threads started from the calling thread, 0 = no cap
+bool mat_gemm_load(const char *path); // reads a tuning cache written by mat_gemm_save
+bool mat_gemm_save(const char *path);
+
+bool labels_alloc(Labels *l, int count);
+void labels_free(Labels *l);
+void labels_copy_range(Labels *dst, const Labels *src, int first); // dst = src[first : first + dst->count]
@@ -0,0 +1,325 @@
+// mnist-stream.c - bounded-memory streaming reader for IDX image/label shards
+#define _GNU_SOURCE
+#include <mnist-stream.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IMAGE_READ_BYTES (4u << 20)
+#define LABEL_READ_BYTES (64u << 10)
+
+static void reader_open(AlignedReader *r, const char *path, size_t cap, bool *direct)
+{
+	int flags = O_RDONLY;
+#ifdef O_DIRECT
+	if (*direct) flags |= O_DIRECT;
+#endif
+
+	r->fd = open(path, flags);
+	if (r->fd < 0 && *direct && errno == EINVAL) {
+		// filesystem (e.g. tmpfs) refuses O_DIRECT: fall back to buffered reads
+		fprintf(stderr, "O_DIRECT not supported for %s, using buffered reads\n", path);
+		*direct = false;
+		r->fd = open(path, O_RDONLY);
+	}
+	if (r->fd < 0) {
+		fprintf(stderr, "Failed to open shard file: %s (%s)\n", path, strerror(errno));
+		exit(1);
+	}
+	r->path = path;
+	r->direct = *direct;
+	r->allow_direct = direct;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	if (!*direct) posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	if (!r->buf) {
+		r->cap = cap;
+		if (posix_memalign((void **)&r->buf, MNIST_STREAM_ALIGN, cap) != 0) {
+			fprintf(stderr, "Failed to allocate stream buffer\n");
+			exit(1);
+		}
+	}
+	r->pos = 0;
+	r->len = 0;
+	r->offset = 0;
+}
+
+static void reader_close(AlignedReader *r)
+{
+	if (r->fd >= 0) close(r->fd);
+	r->fd = -1;
+}
+
+static void reader_reopen_buffered(AlignedReader *r)
+{
+	fprintf(stderr, "O_DIRECT reads not supported for %s, using buffered reads\n", r->path);
+	*r->allow_direct = false;
+	r->direct = false;
+
+	close(r->fd);
+	r->fd = open(r->path, O_RDONLY);
+	if (r->fd < 0 || lseek(r->fd, r->offset, SEEK_SET) < 0) {
+		fprintf(stderr, "Failed to reopen shard file: %s (%s)\n", r->path, strerror(errno));
+		exit(1);
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+static void reader_read(AlignedReader *r, void *dst, size_t n)
+{
+	unsigned char *out = (unsigned char *)dst;
+
+	while (n > 0) {
+		if (r->pos == r->len) {
+			// always whole blocks from a block-aligned offset, so O_DIRECT holds
+			ssize_t got = read(r->fd, r->buf, r->cap);
+			if (got < 0 && errno == EINTR) continue;
+			if (got < 0 && errno == EINVAL && r->direct) {
+				// some filesystems accept O_DIRECT at open() and only
+				// refuse it here: continue buffered from the same offset
+				reader_reopen_buffered(r);
+				continue;
+			}
+			if (got < 0) {
+				fprintf(stderr, "Failed to read %s: %s\n", r->path, strerror(errno));
+				exit(1);
+			}
+			if (got == 0) {
+				fprintf(stderr, "Unexpected end of shard data in %s\n", r->path);
+				exit(1);
+			}
+			r->pos = 0;
+			r->len = (size_t)got;
+			r->bytes_read += (uint64_t)got;
+			r->offset += (off_t)got;
+		}
+
+		size_t take = r->len - r->pos;
+		if (take > n) take = n;
+
+		memcpy(out, r->buf + r->pos, take);
+		r->pos += take;
+		out += take;
+		n -= take;
+	}
+}
+
+static uint32_t reader_be_u32(AlignedReader *r)
+{
+	unsigned char b[4];
+	reader_read(r, b, 4);
+
+	return ((uint32_t)b[0] << 24) |
+	       ((uint32_t)b[1] << 16) |
+	       ((uint32_t)b[2] << 8) |
+	       (uint32_t)b[3];
+}
+
+// Opens shard `idx` and validates its headers; returns false past the last shard.
+static bool stream_open_shard(MnistStream *s, int idx)
+{
+	reader_close(&s->images);
+	reader_close(&s->labels);
+
+	if (idx >= s->num_shards) return false;
+	s->shard = idx;
+
+	reader_open(&s->images, s->image_paths[idx], IMAGE_READ_BYTES, &s->direct);
+	reader_open(&s->labels, s->label_paths[idx], LABEL_READ_BYTES, &s->direct);
+
+	uint32_t magic = reader_be_u32(&s->images);
+	uint32_t count = reader_be_u32(&s->images);
+	uint32_t rows = reader_be_u32(&s->images);
+	uint32_t cols = reader_be_u32(&s->images);
+
+	if (magic != 2051) {
+		fprintf(stderr, "Invalid MNIST image magic number in %s\n", s->image_paths[idx]);
+		exit(1);
+	}
+
+	uint32_t label_magic = reader_be_u32(&s->labels);
+	uint32_t label_count = reader_be_u32(&s->labels);
+
+	if (label_magic != 2049) {
+		fprintf(stderr, "Invalid MNIST label magic number in %s\n", s->label_paths[idx]);
+		exit(1);
+	}
+	if (label_count != count) {
+		fprintf(stderr, "Image/label sample counts do not match in shard %d\n", idx);
+		exit(1);
+	}
+
+	int image_size = (int)(rows * cols);
+	if (s->image_size && s->image_size != image_size) {
+		fprintf(stderr, "Shard %s has %d pixels per image, expected %d\n",
+		        s->image_paths[idx], image_size, s->image_size);
+		exit(1);
+	}
+	s->image_size = image_size;
+	s->remaining = count;
+
+	return true;
+}
+
+// Reads the next sample of the sequential stream, moving across shards.
+static bool stream_read_sample(MnistStream *s, unsigned char *pixels, unsigned char *label)
+{
+	while (s->remaining == 0) {
+		if (!stream_open_shard(s, s->shard + 1)) return false;
+	}
+
+	reader_read(&s->images, pixels, (size_t)s->image_size);
+	reader_read(&s->labels, label, 1);
+	s->remaining--;
+
+	return true;
+}
+
+void mnist_stream_open(MnistStream *s,
+                       const char **image_paths,
+                       const char **label_paths,
+                       int num_shards,
+                       int batch,
+                       int shuffle_cap,
+                       bool direct)
+{
+	memset(s, 0, sizeof(*s));
+	s->images.fd = -1;
+	s->labels.fd = -1;
+
+	s->image_paths = image_paths;
+	s->label_paths = label_paths;
+	s->num_shards = num_shards;
+	s->batch = batch;
+	s->pool_cap = shuffle_cap > 1 ? shuffle_cap : 1;
+	s->direct = direct;
+
+	// the first shard fixes image_size for the buffers below
+	stream_open_shard(s, 0);
+
+	size_t image_size = (size_t)s->image_size;
+	s->pool = (unsigned char *)malloc((size_t)s->pool_cap * image_size);
+	s->pool_labels = (unsigned char *)malloc((size_t)s->pool_cap);
+	s->staging = (unsigned char *)malloc((size_t)batch * image_size);
+	s->staging_labels = (unsigned char *)malloc((size_t)batch);
+
+	if (!s->pool || !s->pool_labels || !s->staging || !s->staging_labels) {
+		fprintf(stderr, "Failed to allocate stream buffers\n");
+		exit(1);
+	}
+}
+
+void mnist_stream_rewind(MnistStream *s, uint64_t seed, uint64_t epoch)
+{
+	s->images.bytes_read = 0;
+	s->labels.bytes_read = 0;
+	s->samples = 0;
+	rng_seed(&s->rng, seed, epoch);
+
+	stream_open_shard(s, 0);
+
+	s->pool_count = 0;
+	while (s->pool_count < s->pool_cap &&
+	       stream_read_sample(s,
+	                          s->pool + (size_t)s->pool_count * s->image_size,
+	                          s->pool_labels + s->pool_count)) {
+		s->pool_count++;
+	}
+}
+
+// Draws up to one batch from the shuffle pool into the staging area.
+static int stream_fill_staging(MnistStream *s, Labels *Y)
+{
+	size_t image_size = (size_t)s->image_size;
+	int n = 0;
+
+	while (n < s->batch && s->pool_count > 0) {
+		int j = (int)rng_below(&s->rng, (uint32_t)s->pool_count);
+		unsigned char *slot = s->pool + (size_t)j * image_size;
+
+		memcpy(s->staging + (size_t)n * image_size, slot, image_size);
+		s->staging_labels[n] = s->pool_labels[j];
+		n++;
+
+		// refill the slot from the stream, or shrink the pool once it is drained
+		if (!stream_read_sample(s, slot, &s->pool_labels[j])) {
+			int last = --s->pool_count;
+			if (j != last) {
+				memcpy(slot, s->pool + (size_t)last * image_size, image_size);
+				s->pool_labels[j] = s->pool_labels[last];
+			}
+		}
+	}
+
+	Y->count = n;
+	for (int i = 0; i < n; ++i) {
+		Y->data[i] = s->staging_labels[i];
+	}
+
+	s->samples += (uint64_t)n;
+	return n;
+}
+
+int mnist_stream_next(MnistStream *s, Matrix *X, Labels *Y)
+{
+	int n = stream_fill_staging(s, Y);
+	if (n == 0) return 0;
+
+	size_t image_size = (size_t)s->image_size;
+	X->cols = n;
+
+	// staging is sample-major, X is (pixel x sample)
+	for (size_t p = 0; p < image_size; ++p) {
+		float *row = X->data + p * (size_t)n;
+		for (int i = 0; i < n; ++i) {
+			row[i] = s->staging[(size_t)i * image_size + p] / 255.0f;
+		}
+	}
+
+	return n;
+}
+
+int mnist_stream_next_u8(MnistStream *s, MatrixU8 *X, Labels *Y)
+{
+	int n = stream_fill_staging(s, Y);
+	if (n == 0) return 0;
+
+	size_t image_size = (size_t)s->image_size;
+	X->cols = n;
+
+	for (size_t p = 0; p < image_size; ++p) {
+		unsigned char *row = X->data + p * (size_t)n;
+		for (int i = 0; i < n; ++i) {
+			row[i] = s->staging[(size_t)i * image_size + p];
+		}
+	}
+
+	return n;
+}
+
+uint64_t mnist_stream_bytes_read(const MnistStream *s)
+{
+	return s->images.bytes_read + s->labels.bytes_read;
+}
+
+void mnist_stream_close(MnistStream *s)
+{
+	reader_close(&s->images);
+	reader_close(&s->labels);
+
+	free(s->images.buf);
+	free(s->labels.buf);
+	free(s->pool);
+	free(s->pool_labels);
+	free(s->staging);
+	free(s->staging_labels);
+
+	memset(s, 0, sizeof(*s));
+}
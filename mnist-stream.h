@@ -0,0 +1,65 @@
+// mnist-stream.h - bounded-memory streaming reader for IDX image/label shards
+#pragma once
+
+#include <matrix.h>
+#include <rng.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define MNIST_STREAM_ALIGN 4096 // O_DIRECT needs block-aligned buffers, sizes and offsets
+
+typedef struct {
+	int fd;
+	unsigned char *buf;   // MNIST_STREAM_ALIGN-aligned block buffer
+	size_t cap;           // bytes per read(), multiple of MNIST_STREAM_ALIGN
+	size_t pos;           // bytes of buf already consumed
+	size_t len;           // valid bytes in buf
+	uint64_t bytes_read;  // total bytes pulled from disk since the last rewind
+	off_t offset;         // file offset of the next read
+	const char *path;
+	bool direct;          // fd was opened with O_DIRECT
+	bool *allow_direct;   // the stream's flag, cleared when O_DIRECT turns out unsupported
+} AlignedReader;
+
+typedef struct {
+	const char **image_paths;
+	const char **label_paths;
+	int num_shards;
+	int shard;              // shard currently being read
+	uint32_t remaining;     // samples left unread in that shard
+
+	AlignedReader images;
+	AlignedReader labels;
+	int image_size;         // rows * cols, identical across shards
+
+	// approximate shuffling: samples are drawn at random from a pool that
+	// is refilled from the sequential stream
+	unsigned char *pool;        // (pool_cap x image_size) raw pixels
+	unsigned char *pool_labels; // (pool_cap)
+	int pool_cap;
+	int pool_count;
+	Rng rng;
+
+	// mini-batch staging, sample-major, transposed into X on output
+	unsigned char *staging;
+	unsigned char *staging_labels;
+	int batch;
+
+	bool direct;            // open shards with O_DIRECT
+
+	uint64_t samples;       // samples emitted this epoch
+} MnistStream;
+
+void mnist_stream_open(MnistStream *s,
+                       const char **image_paths,
+                       const char **label_paths,
+                       int num_shards,
+                       int batch,
+                       int shuffle_cap,
+                       bool direct);
+void mnist_stream_rewind(MnistStream *s, uint64_t seed, uint64_t epoch); // starts a new epoch from shard 0, shuffled by (seed, epoch)
+int mnist_stream_next(MnistStream *s, Matrix *X, Labels *Y); // X: (image_size x batch), Y: (batch); returns columns filled, 0 at end of epoch
+int mnist_stream_next_u8(MnistStream *s, MatrixU8 *X, Labels *Y); // same, keeping raw pixel bytes
+uint64_t mnist_stream_bytes_read(const MnistStream *s); // bytes read from disk since the last rewind
+void mnist_stream_close(MnistStream *s);
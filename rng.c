@@ -0,0 +1,221 @@
+// rng.c - counter-based random numbers (Philox4x32-10)
+#include <rng.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_LANES 8 // blocks generated side by side by the bulk fill
+#define PHILOX_GROUPS (PHILOX_LANES / 4)
+
+static inline void philox_block(const uint32_t key[2], uint64_t counter, uint64_t stream, uint32_t out[4])
+{
+	uint32_t c0 = (uint32_t)counter;
+	uint32_t c1 = (uint32_t)(counter >> 32);
+	uint32_t c2 = (uint32_t)stream;
+	uint32_t c3 = (uint32_t)(stream >> 32);
+	uint32_t k0 = key[0];
+	uint32_t k1 = key[1];
+
+	for (int round = 0; round < 10; ++round) {
+		uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+		uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+
+		uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		uint32_t n1 = (uint32_t)p1;
+		uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		uint32_t n3 = (uint32_t)p0;
+
+		c0 = n0; c1 = n1; c2 = n2; c3 = n3;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+// top 24 bits -> [0, 1), exact in float
+static inline float u32_to_unit(uint32_t x)
+{
+	return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+#if defined(__SSE2__)
+
+// hi/lo halves of the 32 x 32 -> 64 bit products a[i] * m in each lane
+static inline void mul_hilo_x4(__m128i a, __m128i m, __m128i *hi, __m128i *lo)
+{
+	__m128i even = _mm_mul_epu32(a, m);                     // lanes 0, 2
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);  // lanes 1, 3
+
+	*lo = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+	                         _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	*hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 3, 1)),
+	                         _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 3, 1)));
+}
+
+static inline __m128 unit_x4(__m128i x, __m128 range, __m128 min)
+{
+	__m128 u = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+	return _mm_add_ps(_mm_mul_ps(u, range), min);
+}
+
+// PHILOX_LANES consecutive blocks starting at `counter`, written as
+// 4 * PHILOX_LANES floats in stream order. Each SSE register holds one
+// word of four blocks, so a round advances four counters at once; the
+// groups are independent and overlap in the pipeline.
+static void philox_lanes(const uint32_t key[2], uint64_t counter, uint64_t stream, float *dst, float range, float min)
+{
+	__m128i c0[PHILOX_GROUPS], c1[PHILOX_GROUPS], c2[PHILOX_GROUPS], c3[PHILOX_GROUPS];
+	const __m128i m0 = _mm_set1_epi32((int)PHILOX_M0);
+	const __m128i m1 = _mm_set1_epi32((int)PHILOX_M1);
+	uint32_t k0 = key[0];
+	uint32_t k1 = key[1];
+
+	for (int g = 0; g < PHILOX_GROUPS; ++g) {
+		uint64_t c = counter + 4 * (uint64_t)g;
+		c0[g] = _mm_setr_epi32((int)(uint32_t)c, (int)(uint32_t)(c + 1),
+		                       (int)(uint32_t)(c + 2), (int)(uint32_t)(c + 3));
+		c1[g] = _mm_setr_epi32((int)(uint32_t)(c >> 32), (int)(uint32_t)((c + 1) >> 32),
+		                       (int)(uint32_t)((c + 2) >> 32), (int)(uint32_t)((c + 3) >> 32));
+		c2[g] = _mm_set1_epi32((int)(uint32_t)stream);
+		c3[g] = _mm_set1_epi32((int)(uint32_t)(stream >> 32));
+	}
+
+	for (int round = 0; round < 10; ++round) {
+		__m128i vk0 = _mm_set1_epi32((int)k0);
+		__m128i vk1 = _mm_set1_epi32((int)k1);
+
+		for (int g = 0; g < PHILOX_GROUPS; ++g) {
+			__m128i hi0, lo0, hi1, lo1;
+			mul_hilo_x4(c0[g], m0, &hi0, &lo0);
+			mul_hilo_x4(c2[g], m1, &hi1, &lo1);
+
+			c0[g] = _mm_xor_si128(_mm_xor_si128(hi1, c1[g]), vk0);
+			c2[g] = _mm_xor_si128(_mm_xor_si128(hi0, c3[g]), vk1);
+			c1[g] = lo1;
+			c3[g] = lo0;
+		}
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	__m128 vrange = _mm_set1_ps(range);
+	__m128 vmin = _mm_set1_ps(min);
+
+	for (int g = 0; g < PHILOX_GROUPS; ++g) {
+		__m128 w0 = unit_x4(c0[g], vrange, vmin);
+		__m128 w1 = unit_x4(c1[g], vrange, vmin);
+		__m128 w2 = unit_x4(c2[g], vrange, vmin);
+		__m128 w3 = unit_x4(c3[g], vrange, vmin);
+
+		// words-by-block -> block-by-words, i.e. stream order
+		_MM_TRANSPOSE4_PS(w0, w1, w2, w3);
+
+		float *out = dst + 16 * g;
+		_mm_storeu_ps(out + 0, w0);
+		_mm_storeu_ps(out + 4, w1);
+		_mm_storeu_ps(out + 8, w2);
+		_mm_storeu_ps(out + 12, w3);
+	}
+}
+
+#else
+
+static void philox_lanes(const uint32_t key[2], uint64_t counter, uint64_t stream, float *dst, float range, float min)
+{
+	uint32_t out[4];
+
+	for (int l = 0; l < PHILOX_LANES; ++l) {
+		philox_block(key, counter + (uint64_t)l, stream, out);
+		for (int w = 0; w < 4; ++w) {
+			dst[4 * l + w] = u32_to_unit(out[w]) * range + min;
+		}
+	}
+}
+
+#endif
+
+void rng_seed(Rng *r, uint64_t seed, uint64_t stream)
+{
+	r->key[0] = (uint32_t)seed;
+	r->key[1] = (uint32_t)(seed >> 32);
+	r->stream = stream;
+	r->counter = 0;
+	r->idx = 4;
+}
+
+uint32_t rng_u32(Rng *r)
+{
+	if (r->idx == 4) {
+		philox_block(r->key, r->counter++, r->stream, r->buf);
+		r->idx = 0;
+	}
+	return r->buf[r->idx++];
+}
+
+float rng_uniform(Rng *r)
+{
+	return u32_to_unit(rng_u32(r));
+}
+
+uint32_t rng_below(Rng *r, uint32_t n)
+{
+	// multiply-shift range reduction; bias is at most n / 2^32
+	return (uint32_t)(((uint64_t)rng_u32(r) * n) >> 32);
+}
+
+void rng_fill_uniform_at(const Rng *r, uint64_t offset, float *dst, size_t n, float min, float max)
+{
+	float range = max - min;
+	uint64_t block = offset / 4;
+	size_t word = (size_t)(offset % 4);
+	size_t i = 0;
+	uint32_t out[4];
+
+	// leading partial block
+	if (word != 0 && n > 0) {
+		philox_block(r->key, block++, r->stream, out);
+		for (; word < 4 && i < n; ++word) {
+			dst[i++] = u32_to_unit(out[word]) * range + min;
+		}
+	}
+
+	// whole groups of PHILOX_LANES blocks, counters side by side
+	for (; i + 4 * PHILOX_LANES <= n; i += 4 * PHILOX_LANES) {
+		philox_lanes(r->key, block, r->stream, dst + i, range, min);
+		block += PHILOX_LANES;
+	}
+
+	// remaining whole blocks
+	for (; i + 4 <= n; i += 4) {
+		philox_block(r->key, block++, r->stream, out);
+		dst[i + 0] = u32_to_unit(out[0]) * range + min;
+		dst[i + 1] = u32_to_unit(out[1]) * range + min;
+		dst[i + 2] = u32_to_unit(out[2]) * range + min;
+		dst[i + 3] = u32_to_unit(out[3]) * range + min;
+	}
+
+	if (i < n) {
+		philox_block(r->key, block, r->stream, out);
+		for (word = 0; i < n; ++word) {
+			dst[i++] = u32_to_unit(out[word]) * range + min;
+		}
+	}
+}
+
+void rng_fill_uniform(Rng *r, float *dst, size_t n, float min, float max)
+{
+	// bulk fills start on a fresh block so they are addressable by offset
+	rng_fill_uniform_at(r, r->counter * 4, dst, n, min, max);
+	r->counter += (n + 3) / 4;
+	r->idx = 4;
+}
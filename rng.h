@@ -0,0 +1,28 @@
+// rng.h - counter-based random numbers (Philox4x32-10)
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every output is a pure function of (seed, stream, counter), so streams
+// are reproducible, need no shared state between threads, and any range
+// of a bulk fill can be generated independently of the rest.
+typedef struct {
+	uint32_t key[2];   // derived from the seed
+	uint64_t stream;   // independent stream id (layer, epoch, thread, ...)
+	uint64_t counter;  // next 128-bit block to generate
+	uint32_t buf[4];   // current block
+	int idx;           // next unused word of buf, 4 = empty
+} Rng;
+
+void rng_seed(Rng *r, uint64_t seed, uint64_t stream);
+uint32_t rng_u32(Rng *r);
+float rng_uniform(Rng *r); // [0, 1)
+uint32_t rng_below(Rng *r, uint32_t n); // [0, n)
+
+// dst[i] = uniform in [min, max) for the i-th word after the current block;
+// advances r past the words used
+void rng_fill_uniform(Rng *r, float *dst, size_t n, float min, float max);
+// dst[i] = word (offset + i) of r's stream; does not touch r, so threads can
+// each fill their own range and match a single rng_fill_uniform
+void rng_fill_uniform_at(const Rng *r, uint64_t offset, float *dst, size_t n, float min, float max);
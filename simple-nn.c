@@ -1,8 +1,15 @@
 #include <matrix.h>
+#include <mnist-stream.h>
+#include <augment.h>
+#include <lr-schedule.h>
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 typedef struct 
 {
@@ -13,6 +20,9 @@ typedef struct
     Matrix Z;  // pre-activation cache (out_dim x batch)
     Matrix A;  // activations cache    (out_dim x batch) 
 
+    MatrixU8 Xq;   // uint8 input cache (in_dim x batch), live when x_scale > 0
+    float x_scale; // dequantization scale of Xq, 0 for float inputs
+
     Matrix dW; // backprop weights - same shape as W
     Matrix dB; // backprop biases  - same shape as b
 
@@ -43,7 +53,6 @@ typedef struct {
     Matrix z1, a1;
     Matrix z2, a2;
     Matrix logits;      // (num_classes x batch)
-    Matrix y_onehot;    // (num_classes x batch)
     Matrix probs;       // (num_classes x batch)
 
     Matrix dlogits;     // (num_classes x batch)
@@ -55,11 +64,25 @@ typedef struct {
     int hidden2;
     int num_classes;
     int max_batch;
+
+    // Activation memory budget: every per-sample buffer above is sized for
+    // `chunk` columns, and mlp_train_step walks a batch in chunks of that
+    // width, accumulating gradients before the single SGD update.
+    int chunk;
+    Matrix x_chunk;     // (input_dim x chunk) staging, only when chunk < max_batch
+    Labels y_chunk;     // (chunk)
+
+    // uint8 inputs: fc1 reads them directly and folds x_scale into its GEMM
+    bool u8_input;
+    float x_scale;
+    MatrixU8 xq_chunk;  // replaces x_chunk when u8_input
 } MLP;
 
-void dense_init(DenseLayer *l, int in_dim, int out_dim, int max_batch);
+void dense_init(DenseLayer *l, int in_dim, int out_dim, int max_batch, Rng *rng);
 void dense_forward(DenseLayer* layer, const Matrix* X, Matrix* Z_out, bool training);
+void dense_forward_u8(DenseLayer* layer, const MatrixU8* X, float x_scale, Matrix* Z_out, bool training);
 void dense_backward(DenseLayer *l, const Matrix *dZ, Matrix *dA_out);
+void dense_backward_acc(DenseLayer *l, const Matrix *dZ, Matrix *dA_out, float scale);
 void dense_free(DenseLayer* layer);
 void dense_zero_grads(DenseLayer* layer);
 
@@ -76,10 +99,14 @@ float binary_cross_entropy(const Matrix *A, const Matrix *Y);
 void binary_cross_entropy_backward(const Matrix *A, const Matrix *Y, Matrix *dZ_out);
 
 bool mlp_init(MLP *m, int input_dim, int hidden1, int hidden2, int num_classes, int max_batch);
+bool mlp_init_ex(MLP *m, int input_dim, int hidden1, int hidden2, int num_classes, int max_batch, size_t act_budget, uint64_t seed);
+size_t mlp_bytes_per_column(int input_dim, int hidden1, int hidden2, int num_classes);
+void mlp_use_u8_input(MLP *m, float x_scale);
+void mlp_free(MLP *m);
 
 
 
-void dense_init(DenseLayer *l, int in_dim, int out_dim, int max_batch)
+void dense_init(DenseLayer *l, int in_dim, int out_dim, int max_batch, Rng *rng)
 {
     l->in_dim  = in_dim;
     l->out_dim = out_dim;
@@ -94,7 +121,7 @@ void dense_init(DenseLayer *l, int in_dim, int out_dim, int max_batch)
 
     // He initialization (uniform)
     float limit = sqrtf(6.0f / in_dim);
-    mat_rand_uniform(&l->W, -limit, limit);
+    mat_rand_uniform(&l->W, rng, -limit, limit);
 
     mat_zero(&l->b);
     mat_zero(&l->dW);
@@ -112,22 +139,44 @@ void dense_forward(DenseLayer *l, const Matrix *X, Matrix *Z_out, bool training)
     mat_mul(Z_out, &l->W, X);
     mat_add_bias_cols(Z_out, &l->b);
 
+    l->x_scale = 0.0f;
+
     if (training) {
         mat_copy(&l->X, X);
         mat_copy(&l->Z, Z_out);
     }
 }
 
-void dense_backward(DenseLayer *l, const Matrix *dZ, Matrix *dA_out)
+void dense_forward_u8(DenseLayer *l, const MatrixU8 *X, float x_scale, Matrix *Z_out, bool training)
 {
-    int B = dZ->cols;
+    // Z = W·(x_scale * X) + b, dequantized inside the GEMM
+    mat_mul_u8(Z_out, &l->W, X, x_scale);
+    mat_add_bias_cols(Z_out, &l->b);
 
-    mat_mul_A_BT(&l->dW, dZ, &l->X);
-    mat_sum_cols(&l->dB, dZ);
+    l->x_scale = x_scale;
 
-    float invB = 1.0f / (float)B;
-    mat_scale(&l->dW, invB);
-    mat_scale(&l->dB, invB);
+    if (training) {
+        mat_u8_copy(&l->Xq, X);
+        mat_copy(&l->Z, Z_out);
+    }
+}
+
+void dense_backward(DenseLayer *l, const Matrix *dZ, Matrix *dA_out)
+{
+    dense_zero_grads(l);
+    dense_backward_acc(l, dZ, dA_out, 1.0f / (float)dZ->cols);
+}
+
+// dW += scale * dZ·X^T, dB += scale * sum(dZ); lets a batch be processed in
+// column chunks with scale = 1 / full_batch
+void dense_backward_acc(DenseLayer *l, const Matrix *dZ, Matrix *dA_out, float scale)
+{
+    if (l->x_scale > 0.0f) {
+        mat_mul_A_BT_u8_acc(&l->dW, dZ, &l->Xq, scale * l->x_scale);
+    } else {
+        mat_mul_A_BT_acc(&l->dW, dZ, &l->X, scale);
+    }
+    mat_sum_cols_acc(&l->dB, dZ, scale);
 
     if (dA_out) {
         mat_mul_AT_B(dA_out, &l->W, dZ);
@@ -139,6 +188,7 @@ void dense_free(DenseLayer *l)
     mat_free(&l->W);
     mat_free(&l->b);
     mat_free(&l->X);
+    mat_u8_free(&l->Xq);
     mat_free(&l->Z);
     mat_free(&l->A);
     mat_free(&l->dW);
@@ -255,7 +305,8 @@ typedef struct
 } SoftmaxCE;
 
 
-float softmax_ce_forward(const Matrix* Z, Matrix* Y_onehot, SoftmaxCE* head)
+// labels: one class id per column of Z; ids outside [0, Z->rows) add no loss
+float softmax_ce_forward(const Matrix* Z, const int* labels, SoftmaxCE* head)
 {
     float loss = 0.0f;
 
@@ -285,36 +336,68 @@ float softmax_ce_forward(const Matrix* Z, Matrix* Y_onehot, SoftmaxCE* head)
             head->probs.data[j * Z->cols + i] *= inv_sum;
         }
 
-        // CE loss
-        for (int j = 0; j < Z->rows; j++)
+        // CE loss, read straight from the target class
+        int cls = labels[i];
+        if (cls >= 0 && cls < Z->rows)
         {
-            float y = Y_onehot->data[j * Z->cols + i];
-            if (y > 0.0f)
-            {
-                float p = head->probs.data[j * Z->cols + i];
-                loss -= logf(p + 1e-9f);
-            }
+            float p = head->probs.data[cls * Z->cols + i];
+            loss -= logf(p + 1e-9f);
         }
     }
     head->loss = loss / Z->cols;
     return head->loss;
 }
 
-void softmax_ce_backward(const SoftmaxCE *head, const Matrix *Y_onehot, Matrix *dZ_out)
+// dZ = probs - onehot(labels), without materializing the one-hot matrix
+void softmax_ce_backward(const SoftmaxCE *head, const int *labels, Matrix *dZ_out)
 {
-    size_t n = (size_t)head->probs.rows * (size_t)head->probs.cols;
+    int rows = head->probs.rows;
+    int cols = head->probs.cols;
+    size_t n = (size_t)rows * (size_t)cols;
 
-    for (size_t i = 0; i < n; ++i) {
-        dZ_out->data[i] = head->probs.data[i] - Y_onehot->data[i];
+    memcpy(dZ_out->data, head->probs.data, n * sizeof(float));
+
+    for (int i = 0; i < cols; ++i) {
+        int cls = labels[i];
+        if (cls >= 0 && cls < rows) {
+            dZ_out->data[cls * cols + i] -= 1.0f;
+        }
     }
 }
 
+// floats held per batch column by the layer caches and scratch buffers
+size_t mlp_bytes_per_column(int input_dim, int hidden1, int hidden2, int num_classes)
+{
+    size_t floats =
+        (size_t)input_dim            // fc1.X
+        + 8 * (size_t)hidden1        // fc1.Z/A, fc2.X, relu1.Z, z1, a1, da1, dz1
+        + 8 * (size_t)hidden2        // fc2.Z/A, fc3.X, relu2.Z, z2, a2, da2, dz2
+        + 5 * (size_t)num_classes;   // fc3.Z/A, logits, probs, dlogits
+
+    return floats * sizeof(float);
+}
+
 bool mlp_init(MLP *m,
               int input_dim,
               int hidden1,
               int hidden2,
               int num_classes,
               int max_batch)
+{
+    return mlp_init_ex(m, input_dim, hidden1, hidden2, num_classes, max_batch, 0, 1);
+}
+
+// act_budget: bytes allowed for per-column activations and gradients
+// (0 = unlimited). A smaller budget trains the same batch in narrower chunks.
+// seed: weight init; each layer draws from its own stream of it.
+bool mlp_init_ex(MLP *m,
+                 int input_dim,
+                 int hidden1,
+                 int hidden2,
+                 int num_classes,
+                 int max_batch,
+                 size_t act_budget,
+                 uint64_t seed)
 {
     if (!m) return false;
 
@@ -325,11 +408,33 @@ bool mlp_init(MLP *m,
     m->hidden2   = hidden2;
     m->num_classes = num_classes;
     m->max_batch = max_batch;
+    m->chunk     = max_batch;
+
+    if (act_budget > 0) {
+        // staging copy of the input chunk + its labels
+        size_t per_col = mlp_bytes_per_column(input_dim, hidden1, hidden2, num_classes)
+                       + (size_t)input_dim * sizeof(float) + sizeof(int);
+        size_t cols = act_budget / per_col;
+
+        if (cols < 1) cols = 1;
+        if (cols < (size_t)max_batch) m->chunk = (int)cols;
+    }
+
+    if (m->chunk < max_batch) {
+        mat_alloc(&m->x_chunk, input_dim, m->chunk);
+        labels_alloc(&m->y_chunk, m->chunk);
+    }
+
+    max_batch = m->chunk;
 
     /* ---------- Dense layers ---------- */
-    dense_init(&m->fc1, input_dim, hidden1, max_batch);
-    dense_init(&m->fc2, hidden1, hidden2, max_batch);
-    dense_init(&m->fc3, hidden2, num_classes, max_batch);
+    Rng rng;
+    rng_seed(&rng, seed, 1);
+    dense_init(&m->fc1, input_dim, hidden1, max_batch, &rng);
+    rng_seed(&rng, seed, 2);
+    dense_init(&m->fc2, hidden1, hidden2, max_batch, &rng);
+    rng_seed(&rng, seed, 3);
+    dense_init(&m->fc3, hidden2, num_classes, max_batch, &rng);
 
     /* ---------- Activations ---------- */
     relu_init(&m->relu1, hidden1, max_batch);
@@ -343,7 +448,6 @@ bool mlp_init(MLP *m,
     mat_alloc(&m->a2, hidden2, max_batch);
 
     mat_alloc(&m->logits, num_classes, max_batch);
-    mat_alloc(&m->y_onehot, num_classes, max_batch);
     mat_alloc(&m->probs, num_classes, max_batch);
 
     /* ---------- Backward scratch buffers ---------- */
@@ -356,22 +460,110 @@ bool mlp_init(MLP *m,
     return true;
 }
 
+// Switch fc1 to uint8 inputs: its float input cache is replaced by a
+// uint8 one, so inputs stay at one byte per pixel through the step.
+void mlp_use_u8_input(MLP *m, float x_scale)
+{
+    m->u8_input = true;
+    m->x_scale = x_scale;
 
-float mlp_train_step(MLP *m,
-                     const Matrix *X,   // (input_dim x batch)
-                     const Matrix *y,   // (1 x batch), class ids [0, num_classes)
-                     float lr)
+    mat_free(&m->fc1.X);
+    m->fc1.X.data = NULL;
+    mat_u8_alloc(&m->fc1.Xq, m->input_dim, m->chunk);
+
+    if (m->x_chunk.data) {
+        mat_free(&m->x_chunk);
+        m->x_chunk.data = NULL;
+        mat_u8_alloc(&m->xq_chunk, m->input_dim, m->chunk);
+    }
+}
+
+void mlp_free(MLP *m)
+{
+    dense_free(&m->fc1);
+    dense_free(&m->fc2);
+    dense_free(&m->fc3);
+    relu_free(&m->relu1);
+    relu_free(&m->relu2);
+
+    Matrix *scratch[] = {
+        &m->z1, &m->a1, &m->z2, &m->a2,
+        &m->logits, &m->probs,
+        &m->dlogits, &m->da2, &m->dz2, &m->da1, &m->dz1,
+        &m->x_chunk,
+    };
+    for (size_t i = 0; i < sizeof(scratch) / sizeof(scratch[0]); ++i) {
+        mat_free(scratch[i]);
+    }
+    labels_free(&m->y_chunk);
+    mat_u8_free(&m->xq_chunk);
+}
+
+// Resize every per-column buffer to the current chunk width (<= capacity).
+static void mlp_set_cols(MLP *m, int cols)
+{
+    assert(cols <= m->chunk);
+
+    DenseLayer *fc[3] = { &m->fc1, &m->fc2, &m->fc3 };
+    for (int i = 0; i < 3; ++i) {
+        fc[i]->X.cols = cols;
+        fc[i]->Z.cols = cols;
+        fc[i]->A.cols = cols;
+    }
+    m->fc1.Xq.cols = cols;
+    m->relu1.Z.cols = cols;
+    m->relu2.Z.cols = cols;
+
+    Matrix *scratch[] = {
+        &m->z1, &m->a1, &m->z2, &m->a2,
+        &m->logits, &m->probs,
+        &m->dlogits, &m->da2, &m->dz2, &m->da1, &m->dz1,
+    };
+    for (size_t i = 0; i < sizeof(scratch) / sizeof(scratch[0]); ++i) {
+        scratch[i]->cols = cols;
+    }
+}
+
+// Inference forward pass over one chunk (X, or Xq when u8_input); no
+// layer caches are written. Logits land in m->logits.
+static void mlp_infer(MLP *m, const Matrix *X, const MatrixU8 *Xq, int cols)
 {
+    mlp_set_cols(m, cols);
+
+    if (Xq) {
+        dense_forward_u8(&m->fc1, Xq, m->x_scale, &m->z1, false);
+    } else {
+        dense_forward(&m->fc1, X, &m->z1, false);
+    }
+    relu_forward(&m->relu1, &m->z1, &m->a1, false);
+
+    dense_forward(&m->fc2, &m->a1, &m->z2, false);
+    relu_forward(&m->relu2, &m->z2, &m->a2, false);
+
+    dense_forward(&m->fc3, &m->a2, &m->logits, false);
+}
+
+// Forward + backward over one chunk; the input is X, or Xq when u8_input.
+// Gradients are accumulated with grad_scale (1 / full batch). Returns the
+// mean loss over the chunk.
+static float mlp_forward_backward(MLP *m,
+                                  const Matrix *X,
+                                  const MatrixU8 *Xq,
+                                  const Labels *y,
+                                  float grad_scale)
+{
+    mlp_set_cols(m, y->count);
+
     /* =====================
        Forward pass
        ===================== */
-    assert(X->rows == m->input_dim);
-    assert(y->rows == 1);
-    assert(X->cols == y->cols);
-
 
     // Layer 1
-    dense_forward(&m->fc1, X, &m->z1, true);
+    if (Xq) {
+        dense_forward_u8(&m->fc1, Xq, m->x_scale, &m->z1, true);
+    } else {
+        dense_forward(&m->fc1, X, &m->z1, true);
+    }
     relu_forward(&m->relu1, &m->z1, &m->a1, true);
 
     // Layer 2
@@ -381,38 +573,64 @@ float mlp_train_step(MLP *m,
     // Output layer (logits)
     dense_forward(&m->fc3, &m->a2, &m->logits, true);
 
-    // One-hot labels
-    mat_zero(&m->y_onehot);
-    for (int i = 0; i < y->cols; ++i) {
-        int cls = (int)y->data[i];
-        if (cls >= 0 && cls < m->num_classes) {
-            m->y_onehot.data[cls * y->cols + i] = 1.0f;
-        }
-    }
-
     SoftmaxCE head = {
         .probs = m->probs,
         .loss = 0.0f,
     };
-    float loss = softmax_ce_forward(&m->logits, &m->y_onehot, &head);
+    float loss = softmax_ce_forward(&m->logits, y->data, &head);
 
     /* =====================
        Backward pass
        ===================== */
 
-    // dZ3 = probs - y_onehot
-    softmax_ce_backward(&head, &m->y_onehot, &m->dlogits);
+    // dZ3 = probs - onehot(y)
+    softmax_ce_backward(&head, y->data, &m->dlogits);
 
     // Layer 3
-    dense_backward(&m->fc3, &m->dlogits, &m->da2);
+    dense_backward_acc(&m->fc3, &m->dlogits, &m->da2, grad_scale);
     relu_backward(&m->relu2, &m->da2, &m->dz2);
 
     // Layer 2
-    dense_backward(&m->fc2, &m->dz2, &m->da1);
+    dense_backward_acc(&m->fc2, &m->dz2, &m->da1, grad_scale);
     relu_backward(&m->relu1, &m->da1, &m->dz1);
 
     // Layer 1
-    dense_backward(&m->fc1, &m->dz1, NULL);
+    dense_backward_acc(&m->fc1, &m->dz1, NULL, grad_scale);
+
+    return loss;
+}
+
+static float mlp_step(MLP *m,
+                      const Matrix *X,
+                      const MatrixU8 *Xq,
+                      const Labels *y,
+                      float lr)
+{
+    int B = y->count;
+    float invB = 1.0f / (float)B;
+    float loss = 0.0f;
+
+    if (B <= m->chunk) {
+        loss = mlp_forward_backward(m, X, Xq, y, invB);
+    } else {
+        for (int c0 = 0; c0 < B; c0 += m->chunk) {
+            int n = (B - c0 < m->chunk) ? B - c0 : m->chunk;
+
+            m->y_chunk.count = n;
+            labels_copy_range(&m->y_chunk, y, c0);
+
+            if (Xq) {
+                m->xq_chunk.cols = n;
+                mat_u8_copy_cols(&m->xq_chunk, Xq, c0);
+                loss += mlp_forward_backward(m, NULL, &m->xq_chunk, &m->y_chunk, invB) * (float)n;
+            } else {
+                m->x_chunk.cols = n;
+                mat_copy_cols(&m->x_chunk, X, c0);
+                loss += mlp_forward_backward(m, &m->x_chunk, NULL, &m->y_chunk, invB) * (float)n;
+            }
+        }
+        loss *= invB;
+    }
 
     /* =====================
        SGD update (ONCE)
@@ -440,31 +658,824 @@ float mlp_train_step(MLP *m,
     return loss;
 }
 
+float mlp_train_step(MLP *m,
+                     const Matrix *X,   // (input_dim x batch)
+                     const Labels *y,   // (batch), class ids [0, num_classes)
+                     float lr)
+{
+    assert(!m->u8_input);
+    assert(X->rows == m->input_dim);
+    assert(X->cols == y->count);
+    assert(X->cols <= m->max_batch);
+
+    return mlp_step(m, X, NULL, y, lr);
+}
+
+float mlp_train_step_u8(MLP *m,
+                        const MatrixU8 *X, // (input_dim x batch), scaled by m->x_scale
+                        const Labels *y,   // (batch), class ids [0, num_classes)
+                        float lr)
+{
+    assert(m->u8_input);
+    assert(X->rows == m->input_dim);
+    assert(X->cols == y->count);
+    assert(X->cols <= m->max_batch);
+
+    return mlp_step(m, NULL, X, y, lr);
+}
+
 typedef struct
 {
     Matrix *X_batches;
-    Matrix *Y_batches;
+    MatrixU8 *Xq_batches; // compact uint8 images, used instead of X_batches when non-NULL
+    Labels *Y_batches;
     int num_batches;
 } Dataset;
 
 
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* =========================
+   Asynchronous evaluation
+   ========================= */
+
+typedef struct
+{
+    int epoch;          // epoch whose weights were evaluated
+    float loss;         // mean softmax-CE over the validation set
+    float accuracy;     // fraction of correct argmax predictions
+    const int *confusion; // (num_classes x num_classes), [true * C + predicted]
+    double seconds;     // wall time of the pass
+} EvalResult;
+
+// Runs the inference path over a validation set on a background thread.
+// At each epoch boundary the trainer copies its weights into `net` and
+// goes straight back to training; results are collected by polling.
+typedef struct
+{
+    MLP net;              // weight snapshot + private scratch buffers
+    const Dataset *data;  // validation set
+    Matrix x_stage;       // (input_dim x chunk) gathered columns
+    MatrixU8 xq_stage;
+    Labels y_stage;       // (chunk)
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool pending;         // snapshot submitted, not started yet
+    bool busy;            // worker is evaluating
+    bool ready;           // results not collected yet
+    bool quit;
+
+    EvalResult result;
+    int *confusion;
+} Evaluator;
+
+static void evaluator_run(Evaluator *ev)
+{
+    MLP *net = &ev->net;
+    int C = net->num_classes;
+    int chunk = net->max_batch;
+    double t0 = now_seconds();
+
+    memset(ev->confusion, 0, (size_t)C * C * sizeof(int));
+
+    double loss = 0.0;
+    long correct = 0;
+    long total = 0;
+
+    for (int b = 0; b < ev->data->num_batches; ++b) {
+        const Labels *Y = &ev->data->Y_batches[b];
+
+        for (int c0 = 0; c0 < Y->count; c0 += chunk) {
+            int n = (Y->count - c0 < chunk) ? Y->count - c0 : chunk;
+
+            ev->y_stage.count = n;
+            labels_copy_range(&ev->y_stage, Y, c0);
+
+            if (net->u8_input) {
+                ev->xq_stage.cols = n;
+                mat_u8_copy_cols(&ev->xq_stage, &ev->data->Xq_batches[b], c0);
+                mlp_infer(net, NULL, &ev->xq_stage, n);
+            } else {
+                ev->x_stage.cols = n;
+                mat_copy_cols(&ev->x_stage, &ev->data->X_batches[b], c0);
+                mlp_infer(net, &ev->x_stage, NULL, n);
+            }
+
+            SoftmaxCE head = { .probs = net->probs, .loss = 0.0f };
+            loss += (double)softmax_ce_forward(&net->logits, ev->y_stage.data, &head) * n;
+
+            for (int i = 0; i < n; ++i) {
+                int pred = 0;
+                for (int c = 1; c < C; ++c) {
+                    if (net->logits.data[c * n + i] > net->logits.data[pred * n + i]) pred = c;
+                }
+
+                int truth = ev->y_stage.data[i];
+                if (truth >= 0 && truth < C) {
+                    ev->confusion[truth * C + pred]++;
+                }
+                correct += (pred == truth);
+            }
+            total += n;
+        }
+    }
+
+    ev->result.loss = total ? (float)(loss / (double)total) : 0.0f;
+    ev->result.accuracy = total ? (float)correct / (float)total : 0.0f;
+    ev->result.confusion = ev->confusion;
+    ev->result.seconds = now_seconds() - t0;
+}
+
+static void *evaluator_thread(void *arg)
+{
+    Evaluator *ev = (Evaluator *)arg;
+
+    pthread_mutex_lock(&ev->lock);
+    for (;;) {
+        while (!ev->pending && !ev->quit) {
+            pthread_cond_wait(&ev->cond, &ev->lock);
+        }
+        if (ev->quit) break;
+
+        ev->pending = false;
+        ev->busy = true;
+        pthread_mutex_unlock(&ev->lock);
+
+        evaluator_run(ev);
+
+        pthread_mutex_lock(&ev->lock);
+        ev->busy = false;
+        ev->ready = true;
+        pthread_cond_broadcast(&ev->cond);
+    }
+    pthread_mutex_unlock(&ev->lock);
+
+    return NULL;
+}
+
+// chunk: validation columns per inference pass (bounds the evaluator's memory).
+// Returns false, with nothing left to free, if val does not match m or the
+// worker cannot be started.
+bool evaluator_init(Evaluator *ev, const MLP *m, const Dataset *val, int chunk)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->data = val;
+
+    for (int b = 0; b < val->num_batches; ++b) {
+        int rows = val->Xq_batches ? val->Xq_batches[b].rows : val->X_batches[b].rows;
+        if (rows != m->input_dim) {
+            fprintf(stderr, "Validation images have %d pixels, the model expects %d\n", rows, m->input_dim);
+            return false;
+        }
+    }
+
+    if (!mlp_init_ex(&ev->net, m->input_dim, m->hidden1, m->hidden2, m->num_classes, chunk, 0, 0)) {
+        mlp_free(&ev->net);
+        return false;
+    }
+    if (val->Xq_batches) {
+        mlp_use_u8_input(&ev->net, m->u8_input ? m->x_scale : 1.0f / 255.0f);
+        mat_u8_alloc(&ev->xq_stage, m->input_dim, chunk);
+    } else {
+        mat_alloc(&ev->x_stage, m->input_dim, chunk);
+    }
+    labels_alloc(&ev->y_stage, chunk);
+    ev->confusion = (int *)calloc((size_t)m->num_classes * m->num_classes, sizeof(int));
+
+    bool staged = val->Xq_batches ? ev->xq_stage.data != NULL : ev->x_stage.data != NULL;
+    bool ok = staged && ev->y_stage.data && ev->confusion;
+    if (ok) {
+        pthread_mutex_init(&ev->lock, NULL);
+        pthread_cond_init(&ev->cond, NULL);
+
+        ok = pthread_create(&ev->thread, NULL, evaluator_thread, ev) == 0;
+        if (!ok) {
+            pthread_mutex_destroy(&ev->lock);
+            pthread_cond_destroy(&ev->cond);
+        }
+    }
+
+    if (!ok) {
+        mlp_free(&ev->net);
+        mat_free(&ev->x_stage);
+        mat_u8_free(&ev->xq_stage);
+        labels_free(&ev->y_stage);
+        free(ev->confusion);
+    }
+    return ok;
+}
+
+// Snapshots m's weights for evaluation. Returns false (and skips this
+// epoch) if the previous snapshot is still being evaluated, so training
+// never waits on the evaluator.
+bool evaluator_submit(Evaluator *ev, const MLP *m, int epoch)
+{
+    pthread_mutex_lock(&ev->lock);
+    bool idle = !ev->pending && !ev->busy;
+    pthread_mutex_unlock(&ev->lock);
+
+    if (!idle) return false;
+
+    // the worker is parked, so the snapshot needs no further locking
+    mat_copy(&ev->net.fc1.W, &m->fc1.W); mat_copy(&ev->net.fc1.b, &m->fc1.b);
+    mat_copy(&ev->net.fc2.W, &m->fc2.W); mat_copy(&ev->net.fc2.b, &m->fc2.b);
+    mat_copy(&ev->net.fc3.W, &m->fc3.W); mat_copy(&ev->net.fc3.b, &m->fc3.b);
+
+    pthread_mutex_lock(&ev->lock);
+    ev->result.epoch = epoch;
+    ev->ready = false;
+    ev->pending = true;
+    pthread_cond_broadcast(&ev->cond);
+    pthread_mutex_unlock(&ev->lock);
+
+    return true;
+}
+
+// Non-blocking; returns true once per finished evaluation. out->confusion
+// stays valid until the next evaluator_submit.
+bool evaluator_poll(Evaluator *ev, EvalResult *out)
+{
+    pthread_mutex_lock(&ev->lock);
+    bool ready = ev->ready;
+    if (ready) {
+        *out = ev->result;
+        ev->ready = false;
+    }
+    pthread_mutex_unlock(&ev->lock);
+
+    return ready;
+}
+
+// Blocks until the in-flight evaluation (if any) finishes.
+bool evaluator_wait(Evaluator *ev, EvalResult *out)
+{
+    pthread_mutex_lock(&ev->lock);
+    while (ev->pending || ev->busy) {
+        pthread_cond_wait(&ev->cond, &ev->lock);
+    }
+    pthread_mutex_unlock(&ev->lock);
+
+    return evaluator_poll(ev, out);
+}
+
+void evaluator_free(Evaluator *ev)
+{
+    pthread_mutex_lock(&ev->lock);
+    ev->quit = true;
+    pthread_cond_broadcast(&ev->cond);
+    pthread_mutex_unlock(&ev->lock);
+
+    pthread_join(ev->thread, NULL);
+    pthread_mutex_destroy(&ev->lock);
+    pthread_cond_destroy(&ev->cond);
+
+    mlp_free(&ev->net);
+    mat_free(&ev->x_stage);
+    mat_u8_free(&ev->xq_stage);
+    labels_free(&ev->y_stage);
+    free(ev->confusion);
+}
+
+void eval_print(const EvalResult *r)
+{
+    printf("eval  %d | acc %.2f%% | loss %.4f | %.2fs\n",
+           r->epoch, 100.0f * r->accuracy, r->loss, r->seconds);
+}
+
+void eval_print_confusion(const EvalResult *r, int num_classes)
+{
+    printf("confusion (rows = true, cols = predicted)\n");
+    for (int t = 0; t < num_classes; ++t) {
+        for (int p = 0; p < num_classes; ++p) {
+            printf("%6d", r->confusion[t * num_classes + p]);
+        }
+        printf("\n");
+    }
+}
+
+/* =========================
+   Training loops
+   ========================= */
+
+typedef struct
+{
+    int epochs;
+    float lr;           // peak lr when a schedule is set
+    uint64_t seed;      // stream shuffling, drawn from stream `epoch`
+    Evaluator *eval;    // optional validation pass at epoch boundaries
+    const Augment *augment; // optional, applied to in-memory Datasets
+    const LrSchedule *schedule; // optional, per-step multiplier of lr
+
+    // the options below need eval
+    int patience;       // stop after this many evaluations without a new best val loss, 0 = off
+    float min_delta;    // smallest val loss drop that counts as an improvement
+    float target_acc;   // report time to reach this val accuracy, 0 = off
+} TrainOptions;
+
+// Progress of one training run, updated at epoch boundaries.
+typedef struct
+{
+    double t0;
+    double submit_seconds;  // training time when the in-flight snapshot was taken
+    int epochs_run;
+
+    float best_loss;
+    int best_epoch;
+    int stale;              // evaluations since best_loss last improved
+    bool stop;
+
+    int target_epoch;       // -1 until opt->target_acc is reached
+    double target_seconds;
+} TrainState;
+
+static void train_begin(TrainState *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->t0 = now_seconds();
+    st->best_loss = INFINITY;
+    st->best_epoch = -1;
+    st->target_epoch = -1;
+}
+
+// lr for step `step` of `steps` in `epoch`; steps <= 0 when the epoch
+// length is not known yet
+static float train_lr(const TrainOptions *opt, int epoch, long step, long steps)
+{
+    if (!opt->schedule) return opt->lr;
+
+    float pos = (float)epoch;
+    if (steps > 0 && step < steps) pos += (float)step / (float)steps;
+
+    return opt->lr * lr_schedule_scale(opt->schedule, pos);
+}
+
+// Feeds a finished evaluation to early stopping and the target tracker.
+static void train_observe(const TrainOptions *opt, TrainState *st, const EvalResult *r)
+{
+    eval_print(r);
+
+    if (opt->target_acc > 0.0f && st->target_epoch < 0 && r->accuracy >= opt->target_acc) {
+        st->target_epoch = r->epoch;
+        st->target_seconds = st->submit_seconds;
+        printf("target %.2f%% reached at epoch %d after %.2fs\n",
+               100.0f * opt->target_acc, r->epoch, st->target_seconds);
+    }
+
+    if (r->loss < st->best_loss - opt->min_delta) {
+        st->best_loss = r->loss;
+        st->best_epoch = r->epoch;
+        st->stale = 0;
+    } else if (opt->patience > 0 && ++st->stale >= opt->patience) {
+        st->stop = true;
+    }
+}
+
+// Epoch boundary: report any finished evaluation, then hand the new
+// weights to the evaluator. Returns true when training should stop early.
+static bool train_epoch_end(MLP *m, const TrainOptions *opt, TrainState *st, int epoch)
+{
+    EvalResult r;
+
+    st->epochs_run = epoch + 1;
+
+    if (!opt->eval) return false;
+
+    if (evaluator_poll(opt->eval, &r)) {
+        train_observe(opt, st, &r);
+    }
+    if (st->stop) {
+        printf("early stop at epoch %d: val loss has not improved on %.4f (epoch %d) for %d evaluations\n",
+               epoch, st->best_loss, st->best_epoch, opt->patience);
+        return true;
+    }
+
+    if (evaluator_submit(opt->eval, m, epoch)) {
+        st->submit_seconds = now_seconds() - st->t0;
+    } else {
+        printf("eval  %d | skipped, previous pass still running\n", epoch);
+    }
+    return false;
+}
+
+static void train_finish(MLP *m, const TrainOptions *opt, TrainState *st)
+{
+    EvalResult r;
+    double seconds = now_seconds() - st->t0;
+
+    if (opt->eval && evaluator_wait(opt->eval, &r)) {
+        train_observe(opt, st, &r);
+        eval_print_confusion(&r, m->num_classes);
+    }
+
+    printf("trained %d of %d epochs in %.2fs\n", st->epochs_run, opt->epochs, seconds);
+
+    if (opt->target_acc > 0.0f) {
+        if (st->target_epoch >= 0) {
+            printf("time to %.2f%%: %.2fs, %d epochs\n",
+                   100.0f * opt->target_acc, st->target_seconds, st->target_epoch + 1);
+        } else {
+            printf("time to %.2f%%: not reached\n", 100.0f * opt->target_acc);
+        }
+    }
+}
+
+// One pipeline stage of augmentation: batch (epoch, batch) is warped into
+// X/Xq on a background thread while the previous batch trains.
+typedef struct
+{
+    const Augment *aug;
+    const Dataset *data;
+    int epoch;
+    int batch;
+    Matrix X;
+    MatrixU8 Xq;
+    pthread_t thread;
+    bool running;
+} AugmentSlot;
+
+static void *augment_slot_run(void *arg)
+{
+    AugmentSlot *s = (AugmentSlot *)arg;
+    uint64_t stream = (uint64_t)s->epoch * (uint64_t)s->data->num_batches + (uint64_t)s->batch;
+
+    if (s->data->Xq_batches) {
+        s->Xq.cols = s->data->Xq_batches[s->batch].cols;
+        augment_batch_u8(s->aug, stream, &s->data->Xq_batches[s->batch], 0, &s->Xq);
+    } else {
+        s->X.cols = s->data->X_batches[s->batch].cols;
+        augment_batch(s->aug, stream, &s->data->X_batches[s->batch], 0, &s->X);
+    }
+
+    return NULL;
+}
+
+static void augment_slot_start(AugmentSlot *s, int epoch, int batch)
+{
+    s->epoch = epoch;
+    s->batch = batch;
+    s->running = pthread_create(&s->thread, NULL, augment_slot_run, s) == 0;
+    if (!s->running) {
+        augment_slot_run(s);
+    }
+}
+
+static void augment_slot_wait(AugmentSlot *s)
+{
+    if (s->running) {
+        pthread_join(s->thread, NULL);
+        s->running = false;
+    }
+}
+
+void mlp_train_opts(MLP *m,
+                    Dataset *data,
+                    const TrainOptions *opt)
+{
+    AugmentSlot slots[2] = {0};
+    int cur = 0;
+    TrainState st;
+
+    if (opt->augment) {
+        int max_cols = 0;
+        for (int i = 0; i < data->num_batches; ++i) {
+            if (data->Y_batches[i].count > max_cols) max_cols = data->Y_batches[i].count;
+        }
+
+        for (int k = 0; k < 2; ++k) {
+            slots[k].aug = opt->augment;
+            slots[k].data = data;
+            if (data->Xq_batches) {
+                mat_u8_alloc(&slots[k].Xq, m->input_dim, max_cols);
+            } else {
+                mat_alloc(&slots[k].X, m->input_dim, max_cols);
+            }
+        }
+
+        if (opt->epochs > 0) augment_slot_start(&slots[0], 0, 0);
+    }
+
+    train_begin(&st);
+
+    for (int e = 0; e < opt->epochs; ++e) {
+        float epoch_loss = 0.0f;
+
+        for (int i = 0; i < data->num_batches; ++i) {
+            const Matrix *X = data->X_batches ? &data->X_batches[i] : NULL;
+            const MatrixU8 *Xq = data->Xq_batches ? &data->Xq_batches[i] : NULL;
+
+            if (opt->augment) {
+                AugmentSlot *ready = &slots[cur];
+                augment_slot_wait(ready);
+
+                // warp the next batch (possibly next epoch's) while this one trains
+                int ne = (i + 1 == data->num_batches) ? e + 1 : e;
+                int ni = (i + 1 == data->num_batches) ? 0 : i + 1;
+                if (ne < opt->epochs) augment_slot_start(&slots[cur ^ 1], ne, ni);
+
+                X = &ready->X;
+                Xq = &ready->Xq;
+                cur ^= 1;
+            }
+
+            float lr = train_lr(opt, e, i, data->num_batches);
+
+            if (data->Xq_batches) {
+                epoch_loss += mlp_train_step_u8(
+                    m,
+                    Xq,
+                    &data->Y_batches[i],
+                    lr
+                );
+            } else {
+                epoch_loss += mlp_train_step(
+                    m,
+                    X,
+                    &data->Y_batches[i],
+                    lr
+                );
+            }
+        }
+
+        printf("epoch %d | loss %.4f\n", e, epoch_loss / data->num_batches);
+        if (train_epoch_end(m, opt, &st, e)) break;
+    }
+
+    train_finish(m, opt, &st);
+
+    for (int k = 0; k < 2; ++k) {
+        augment_slot_wait(&slots[k]);
+        mat_free(&slots[k].X);
+        mat_u8_free(&slots[k].Xq);
+    }
+}
+
 void mlp_train(MLP *m,
                Dataset *data,
                int epochs,
                float lr)
 {
-    for (int e = 0; e < epochs; ++e) {
+    TrainOptions opt = { .epochs = epochs, .lr = lr };
+    mlp_train_opts(m, data, &opt);
+}
+
+// Out-of-core training: mini-batches come from the stream, so memory stays
+// bounded by the stream's shuffle pool and one batch.
+void mlp_train_stream(MLP *m,
+                      MnistStream *stream,
+                      const TrainOptions *opt)
+{
+    Matrix X = {0};
+    MatrixU8 Xq = {0};
+    Labels Y = {0};
+    if (m->u8_input) {
+        mat_u8_alloc(&Xq, stream->image_size, stream->batch);
+    } else {
+        mat_alloc(&X, stream->image_size, stream->batch);
+    }
+    labels_alloc(&Y, stream->batch);
+
+    // the epoch length is only known once the stream has been read through;
+    // until then the schedule advances once per epoch
+    long epoch_samples = 0;
+    TrainState st;
+    train_begin(&st);
+
+    for (int e = 0; e < opt->epochs; ++e) {
         float epoch_loss = 0.0f;
+        double t0 = now_seconds();
 
-        for (int i = 0; i < data->num_batches; ++i) {
-            epoch_loss += mlp_train_step(
-                m,
-                &data->X_batches[i],
-                &data->Y_batches[i],
-                lr
-            );
+        mnist_stream_rewind(stream, opt->seed, (uint64_t)e);
+
+        int n;
+        if (m->u8_input) {
+            while ((n = mnist_stream_next_u8(stream, &Xq, &Y)) > 0) {
+                float lr = train_lr(opt, e, (long)stream->samples - n, epoch_samples);
+                epoch_loss += mlp_train_step_u8(m, &Xq, &Y, lr) * (float)n;
+            }
+        } else {
+            while ((n = mnist_stream_next(stream, &X, &Y)) > 0) {
+                float lr = train_lr(opt, e, (long)stream->samples - n, epoch_samples);
+                epoch_loss += mlp_train_step(m, &X, &Y, lr) * (float)n;
+            }
         }
+        epoch_samples = (long)stream->samples;
 
-        printf("epoch %d | loss %.4f\n", e, epoch_loss / data->num_batches);
+        double dt = now_seconds() - t0;
+        double mb = (double)mnist_stream_bytes_read(stream) / (1024.0 * 1024.0);
+        double samples = (double)stream->samples;
+
+        printf("epoch %d | loss %.4f | %.1f MB/s | %.0f samples/s\n",
+               e, epoch_loss / (float)samples, mb / dt, samples / dt);
+        if (train_epoch_end(m, opt, &st, e)) break;
+    }
+
+    train_finish(m, opt, &st);
+
+    mat_free(&X);
+    mat_u8_free(&Xq);
+    labels_free(&Y);
+}
+
+/* =========================
+   Hogwild! asynchronous SGD
+   ========================= */
+
+typedef struct
+{
+    int batch;      // index into Dataset batches
+    int col0;       // first column of the mini-batch
+    int cols;
+} HogwildSlice;
+
+typedef struct
+{
+    MLP net;            // private scratch; W/b alias the shared model
+    Matrix x_stage;     // (input_dim x batch)
+    MatrixU8 xq_stage;
+    Labels y_stage;     // (batch)
+
+    const Dataset *data;
+    const HogwildSlice *slices;
+    int num_slices;
+    atomic_int *next;   // shared work counter
+    int gemm_threads;   // this worker's share of the cores
+    const TrainOptions *opt;
+    int epoch;
+
+    double loss;        // sum of per-sample losses this epoch
+    long samples;
+} HogwildWorker;
+
+static void *hogwild_thread(void *arg)
+{
+    HogwildWorker *w = (HogwildWorker *)arg;
+    int i;
+
+    w->loss = 0.0;
+    w->samples = 0;
+
+    // tuned GEMM params may ask for every core; N workers must share them
+    mat_gemm_limit_threads(w->gemm_threads);
+
+    while ((i = atomic_fetch_add_explicit(w->next, 1, memory_order_relaxed)) < w->num_slices) {
+        const HogwildSlice *sl = &w->slices[i];
+
+        w->y_stage.count = sl->cols;
+        labels_copy_range(&w->y_stage, &w->data->Y_batches[sl->batch], sl->col0);
+
+        // the SGD update inside writes straight into the shared W/b with
+        // no locks: Hogwild! tolerates the lost and torn updates
+        // slice i is the i-th update of the epoch, whichever worker takes it
+        float lr = train_lr(w->opt, w->epoch, i, w->num_slices);
+        float loss;
+        if (w->net.u8_input) {
+            w->xq_stage.cols = sl->cols;
+            mat_u8_copy_cols(&w->xq_stage, &w->data->Xq_batches[sl->batch], sl->col0);
+            loss = mlp_train_step_u8(&w->net, &w->xq_stage, &w->y_stage, lr);
+        } else {
+            w->x_stage.cols = sl->cols;
+            mat_copy_cols(&w->x_stage, &w->data->X_batches[sl->batch], sl->col0);
+            loss = mlp_train_step(&w->net, &w->x_stage, &w->y_stage, lr);
+        }
+
+        w->loss += (double)loss * sl->cols;
+        w->samples += sl->cols;
+    }
+
+    return NULL;
+}
+
+// Alternative to the synchronous loops: `threads` workers each run
+// forward/backward on their own mini-batches of `batch` columns and update
+// m's weights concurrently. With threads = 1 this is plain mini-batch SGD,
+// the synchronous baseline. Returns the mean loss of the last epoch.
+float mlp_train_hogwild(MLP *m,
+                        Dataset *data,
+                        const TrainOptions *opt,
+                        int threads,
+                        int batch)
+{
+    // mini-batch slices over every Dataset batch, reshuffled each epoch
+    int num_slices = 0;
+    for (int b = 0; b < data->num_batches; ++b) {
+        num_slices += (data->Y_batches[b].count + batch - 1) / batch;
+    }
+
+    HogwildSlice *slices = (HogwildSlice *)malloc((size_t)num_slices * sizeof(HogwildSlice));
+    HogwildWorker *workers = (HogwildWorker *)calloc((size_t)threads, sizeof(HogwildWorker));
+    pthread_t *tids = (pthread_t *)malloc((size_t)threads * sizeof(pthread_t));
+    if (!slices || !workers || !tids) {
+        fprintf(stderr, "Failed to allocate hogwild workers\n");
+        exit(1);
+    }
+
+    int k = 0;
+    for (int b = 0; b < data->num_batches; ++b) {
+        int cols = data->Y_batches[b].count;
+        for (int c0 = 0; c0 < cols; c0 += batch) {
+            slices[k].batch = b;
+            slices[k].col0 = c0;
+            slices[k].cols = (cols - c0 < batch) ? cols - c0 : batch;
+            k++;
+        }
     }
+
+    atomic_int next;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int gemm_threads = cpus > threads ? (int)cpus / threads : 1;
+
+    for (int t = 0; t < threads; ++t) {
+        HogwildWorker *w = &workers[t];
+
+        mlp_init_ex(&w->net, m->input_dim, m->hidden1, m->hidden2, m->num_classes, batch, 0, 0);
+        if (data->Xq_batches) {
+            mlp_use_u8_input(&w->net, m->u8_input ? m->x_scale : 1.0f / 255.0f);
+            mat_u8_alloc(&w->xq_stage, m->input_dim, batch);
+        } else {
+            mat_alloc(&w->x_stage, m->input_dim, batch);
+        }
+        labels_alloc(&w->y_stage, batch);
+
+        // share the model: drop the worker's own weights and alias m's
+        DenseLayer *own[3] = { &w->net.fc1, &w->net.fc2, &w->net.fc3 };
+        const DenseLayer *shared[3] = { &m->fc1, &m->fc2, &m->fc3 };
+        for (int l = 0; l < 3; ++l) {
+            mat_free(&own[l]->W);
+            mat_free(&own[l]->b);
+            own[l]->W = shared[l]->W;
+            own[l]->b = shared[l]->b;
+        }
+
+        w->data = data;
+        w->slices = slices;
+        w->num_slices = num_slices;
+        w->next = &next;
+        w->gemm_threads = gemm_threads;
+        w->opt = opt;
+    }
+
+    float epoch_loss = 0.0f;
+    TrainState st;
+    train_begin(&st);
+
+    for (int e = 0; e < opt->epochs; ++e) {
+        Rng rng;
+        rng_seed(&rng, opt->seed, (uint64_t)e);
+        for (int i = num_slices - 1; i > 0; --i) {
+            int j = (int)rng_below(&rng, (uint32_t)(i + 1));
+            HogwildSlice tmp = slices[i];
+            slices[i] = slices[j];
+            slices[j] = tmp;
+        }
+
+        atomic_store(&next, 0);
+        double t0 = now_seconds();
+
+        for (int t = 0; t < threads; ++t) {
+            workers[t].epoch = e;
+            pthread_create(&tids[t], NULL, hogwild_thread, &workers[t]);
+        }
+
+        double loss = 0.0;
+        long samples = 0;
+        for (int t = 0; t < threads; ++t) {
+            pthread_join(tids[t], NULL);
+            loss += workers[t].loss;
+            samples += workers[t].samples;
+        }
+
+        double dt = now_seconds() - t0;
+        epoch_loss = (float)(loss / (double)samples);
+
+        printf("epoch %d | loss %.4f | %d threads | %.0f samples/s\n",
+               e, epoch_loss, threads, (double)samples / dt);
+        if (train_epoch_end(m, opt, &st, e)) break;
+    }
+
+    train_finish(m, opt, &st);
+
+    for (int t = 0; t < threads; ++t) {
+        HogwildWorker *w = &workers[t];
+        DenseLayer *own[3] = { &w->net.fc1, &w->net.fc2, &w->net.fc3 };
+        for (int l = 0; l < 3; ++l) {
+            own[l]->W.data = NULL;
+            own[l]->b.data = NULL;
+        }
+        mlp_free(&w->net);
+        mat_free(&w->x_stage);
+        mat_u8_free(&w->xq_stage);
+        labels_free(&w->y_stage);
+    }
+    free(workers);
+    free(tids);
+    free(slices);
+
+    return epoch_loss;
 }